@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JOBBOARD_MAGIC 0x534a4f42	/* "BOJS" */
+#define JOBBOARD_VERSION 1
+#define JOBBOARD_SLOTS 1024
+#define JOBBOARD_CMD_MAX 64
+
+/* Slot status values, the same as the shell's process statuses */
+#define JOB_TERMINATED -1
+#define JOB_SUSPENDED 0
+#define JOB_RUNNING 1
+
+/* Every field has a fixed size and offset, so 32 and 64 bit readers agree on the layout */
+typedef struct jobSlot
+{
+    uint32_t seq;		/* seqlock: odd while the shell is rewriting the slot */
+    int32_t pid;		/* process id. 0 if the slot is free */
+    int32_t status;		/* JOB_RUNNING/JOB_SUSPENDED/JOB_TERMINATED */
+    int32_t exitCode;		/* exit status (128+signal if killed). Valid once JOB_TERMINATED */
+    int64_t startTime;		/* launch time, seconds since the epoch */
+    char command[JOBBOARD_CMD_MAX];	/* command name, 0-terminated */
+} jobSlot;
+
+typedef struct jobBoard
+{
+    uint32_t magic;		/* JOBBOARD_MAGIC once the board is initialized */
+    uint32_t version;		/* JOBBOARD_VERSION */
+    uint32_t slotCount;		/* number of slots */
+    int32_t shellPid;		/* process id of the publishing shell */
+    uint32_t generation;	/* bumped after every slot update, so readers can skip unchanged boards */
+    uint32_t reserved;
+    jobSlot slots[JOBBOARD_SLOTS];
+} jobBoard;
+
+/* Creates (or truncates) the board file at path and maps it */
+/* Returns NULL on failure */
+jobBoard *createJobBoard(const char *path);
+
+/* Unmaps the board and removes its file. Does nothing if board is NULL */
+void destroyJobBoard(jobBoard *board, const char *path);
+
+/* Publishes a newly launched pid as running, starting over any slot an earlier process with the same pid left */
+/* When no slot is free, the oldest terminated one is reclaimed. Does nothing if board is NULL */
+void launchJob(jobBoard *board, pid_t pid, const char *command);
+
+/* Publishes the new state of a launched pid. Does nothing if board is NULL or pid has no slot */
+void publishJob(jobBoard *board, pid_t pid, int status, int exitCode);
+
+/* Frees the slot of pid once it terminated. Does nothing if board is NULL */
+void retireJob(jobBoard *board, pid_t pid);
+
+/* Maps an existing board file read-only for a reader */
+/* Returns NULL on failure or if the file is not a board */
+const jobBoard *openJobBoard(const char *path);
+
+/* Takes a consistent snapshot of slot index without blocking the shell */
+/* Returns 1 if the slot is in use, otherwise - returns 0 */
+int readJobSlot(const jobBoard *board, int index, jobSlot *out);
@@ -0,0 +1,15 @@
+/* Reads one line into buf (at most size-1 bytes, ending with a newline) after printing prompt */
+/* On a terminal the line can be edited in place, history holds count earlier lines (oldest first) for Up/Down, */
+/* and Tab completes command names from PATH and file names */
+/* Returns NULL at end of input */
+char *readLine(const char *prompt, char *buf, int size, char * const *history, int count);
+
+/* Sets extra command names (the shell's builtins) offered by command completion */
+void setBuiltinCommands(const char * const *names, int count);
+
+/* Has readLine call onReady(context) whenever fd becomes readable while it waits for input */
+/* onReady must consume what is pending on fd. Switches stdin to unbuffered reads */
+void setIdleHandler(int fd, void (*onReady)(void *), void *context);
+
+/* Frees the cached PATH index and directory listings */
+void freeLineEditor(void);
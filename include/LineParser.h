@@ -6,19 +6,35 @@ typedef struct cmdLine
     int argCount;		/* number of arguments */
     char const *inputRedirect;	/* input redirection path. NULL if no input redirection */
     char const *outputRedirect;	/* output redirection path. NULL if no output redirection */
+    char const *execPath;	/* resolved path of the executable. NULL if not resolved (execvp searches PATH) */
     char blocking;	/* boolean indicating blocking/non-blocking */
     int idx;				/* index of current command in the chain of cmdLines (0 for the first) */
     struct cmdLine *next;	/* next cmdLine in chain */
 } cmdLine;
 
 /* Parses a given string to arguments and other indicators */
-/* Returns NULL when there's nothing to parse */ 
+/* Returns NULL when there's nothing to parse, or on an unbalanced substitution (reported on stderr) */
 /* When successful, returns a pointer to cmdLine (in case of a pipe, this will be the head of a linked list) */
 cmdLine *parseCmdLines(const char *strLine);	/* Parse string line */
 
+/* Returns the last command of the chain (linked list) */
+cmdLine *lastCmdLine(cmdLine *pCmdLine);
+
+/* Returns a deep copy of the chain (linked list) */
+cmdLine *cloneCmdLines(const cmdLine *pCmdLine);
+
+/* Returns a copy of the chain with strSuffix parsed as if it were typed right after the last command */
+/* Words are appended to the last command, "| ..." adds commands, and "&" makes it non-blocking */
+/* Returns NULL on an unbalanced substitution (reported on stderr) */
+cmdLine *extendCmdLines(const cmdLine *pCmdLine, const char *strSuffix);
+
 /* Releases all allocated memory for the chain (linked list) */
 void freeCmdLines(cmdLine *pCmdLine);		/* Free parsed line */
 
 /* Replaces arguments[num] with newString */
 /* Returns 0 if num is out-of-range, otherwise - returns 1 */
-int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString);
\ No newline at end of file
+int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString);
+
+/* Returns a pointer to the ')' matching the '(' at str (used for $(...), <(...) and >(...) substitutions) */
+/* Returns a pointer to the terminating 0 if the parentheses are unbalanced */
+const char *findSubstitutionEnd(const char *str);
\ No newline at end of file
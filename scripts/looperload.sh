@@ -0,0 +1,40 @@
+#!/bin/sh
+# Drives bin/myshell with bin/looper workloads:
+#   1. launches JOBS background loopers and times how long the shell takes to start and list them.
+#      They sleep unless job_cpu_percent asks each one to burn that share of a CPU, which skews the timing on small machines
+#   2. benchmarks a looper -> looper pipeline to see how fast data moves between stages
+# usage: scripts/looperload.sh [jobs] [pipeline_seconds] [line_bytes] [job_cpu_percent]
+# Build first with: make myshell looper
+
+JOBS=${1:-1000}
+PIPE_SECONDS=${2:-2}
+LINE_BYTES=${3:-4096}
+JOB_CPU=$4
+BIN=$(cd "$(dirname "$0")/../bin" && pwd) || exit 1
+OUT=$(mktemp)
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+echo "== $JOBS background jobs"
+START=$(now_ms)
+{
+    i=0
+    while [ "$i" -lt "$JOBS" ]; do
+        echo "$BIN/looper -q${JOB_CPU:+ -c $JOB_CPU} &"
+        i=$((i + 1))
+    done
+    echo "procs"
+    echo "quit"
+} | "$BIN/myshell" > "$OUT" 2>&1
+END=$(now_ms)
+RUNNING=$(grep -c " Running " "$OUT")
+echo "launched and listed $JOBS jobs in $((END - START)) ms ($RUNNING reported running)"
+awk '/ Running /{print $1}' "$OUT" | xargs -r kill -INT
+
+echo "== pipeline throughput, $LINE_BYTES byte lines for ${PIPE_SECONDS}s"
+printf '%s\nquit\n' "bench -n 3 -w 0 -j $BIN/looper -q -r 0 -l $LINE_BYTES -t $PIPE_SECONDS | $BIN/looper -i" \
+    | "$BIN/myshell" 2>&1 | grep -E '^looper:|^\{'
+
+rm -f "$OUT"
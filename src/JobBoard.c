@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/JobBoard.h"
+
+_Static_assert(sizeof(jobSlot) == 88, "jobSlot layout must not depend on the ABI");
+_Static_assert(sizeof(jobBoard) == 24 + JOBBOARD_SLOTS * sizeof(jobSlot), "jobBoard layout must not depend on the ABI");
+
+jobBoard *createJobBoard(const char *path)
+{
+    jobBoard *board;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        perror("Failed creating job board");
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(jobBoard)) == -1) {
+        perror("Failed sizing job board");
+        close(fd);
+        return NULL;
+    }
+
+    board = mmap(NULL, sizeof(jobBoard), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (board == MAP_FAILED) {
+        perror("Failed mapping job board");
+        return NULL;
+    }
+
+    board->version = JOBBOARD_VERSION;
+    board->slotCount = JOBBOARD_SLOTS;
+    board->shellPid = getpid();
+    /* Readers check the magic, so it is stored last */
+    __atomic_store_n(&board->magic, JOBBOARD_MAGIC, __ATOMIC_RELEASE);
+    return board;
+}
+
+void destroyJobBoard(jobBoard *board, const char *path)
+{
+    if (!board)
+        return;
+
+    munmap(board, sizeof(jobBoard));
+    unlink(path);
+}
+
+static jobSlot *findSlot(jobBoard *board, pid_t pid)
+{
+    int i;
+    for (i = 0; i < JOBBOARD_SLOTS; ++i)
+        if (board->slots[i].pid == pid)
+            return &board->slots[i];
+    return NULL;
+}
+
+/* The shell is the only writer, so the seqlock needs no compare-and-swap */
+static void beginWrite(jobSlot *slot)
+{
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void endWrite(jobBoard *board, jobSlot *slot)
+{
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&board->generation, 1, __ATOMIC_RELEASE);
+}
+
+/* The terminated slot that was launched first, or NULL if every slot holds a live process */
+static jobSlot *oldestTerminated(jobBoard *board)
+{
+    jobSlot *oldest = NULL;
+    int i;
+    for (i = 0; i < JOBBOARD_SLOTS; ++i)
+        if (board->slots[i].status == JOB_TERMINATED && (!oldest || board->slots[i].startTime < oldest->startTime))
+            oldest = &board->slots[i];
+    return oldest;
+}
+
+void launchJob(jobBoard *board, pid_t pid, const char *command)
+{
+    jobSlot *slot;
+
+    if (!board)
+        return;
+
+    /* A slot left by an earlier process with the same pid is started over, not updated */
+    if (!(slot = findSlot(board, pid)) && !(slot = findSlot(board, 0)) && !(slot = oldestTerminated(board))) {
+        fprintf(stderr, "job board full: %d is not published\n", pid);
+        return;
+    }
+
+    beginWrite(slot);
+    slot->pid = pid;
+    slot->status = JOB_RUNNING;
+    slot->exitCode = 0;
+    slot->startTime = time(NULL);
+    strncpy(slot->command, command, JOBBOARD_CMD_MAX - 1);
+    slot->command[JOBBOARD_CMD_MAX - 1] = 0;
+    endWrite(board, slot);
+}
+
+void publishJob(jobBoard *board, pid_t pid, int status, int exitCode)
+{
+    jobSlot *slot;
+
+    if (!board || !(slot = findSlot(board, pid)))
+        return;
+
+    beginWrite(slot);
+    slot->status = status;
+    slot->exitCode = exitCode;
+    endWrite(board, slot);
+}
+
+void retireJob(jobBoard *board, pid_t pid)
+{
+    jobSlot *slot;
+
+    /* Only a finished process is retired, its pid may already name a newly launched one */
+    if (!board || !(slot = findSlot(board, pid)) || slot->status != JOB_TERMINATED)
+        return;
+
+    beginWrite(slot);
+    memset((char*)slot + sizeof(slot->seq), 0, sizeof(jobSlot) - sizeof(slot->seq));
+    endWrite(board, slot);
+}
+
+const jobBoard *openJobBoard(const char *path)
+{
+    const jobBoard *board;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        perror("Failed opening job board");
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(jobBoard)) {
+        fprintf(stderr, "%s: not a job board\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    board = mmap(NULL, sizeof(jobBoard), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (board == MAP_FAILED) {
+        perror("Failed mapping job board");
+        return NULL;
+    }
+
+    if (__atomic_load_n(&board->magic, __ATOMIC_ACQUIRE) != JOBBOARD_MAGIC || board->version != JOBBOARD_VERSION) {
+        fprintf(stderr, "%s: not a job board (or an incompatible version)\n", path);
+        munmap((void*)board, sizeof(jobBoard));
+        return NULL;
+    }
+
+    return board;
+}
+
+int readJobSlot(const jobBoard *board, int index, jobSlot *out)
+{
+    const jobSlot *slot = &board->slots[index];
+    uint32_t before, after;
+
+    do {
+        before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        memcpy(out, slot, sizeof(jobSlot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+
+    return out->pid != 0;
+}
@@ -0,0 +1,715 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <termios.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include "../include/LineEditor.h"
+
+#define FREE(X) if(X) free((void*)X)
+
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+#define MAX_PATH_DIRS 64
+#define DIR_CACHE_SIZE 16
+#define MAX_LISTED 100
+#define PATH_MAX_LEN 4096
+
+/* Prefix trie of command names, children kept in sorted sibling lists */
+typedef struct trieNode
+{
+    char c;
+    char terminal;		/* a name ends at this node */
+    struct trieNode *child;
+    struct trieNode *sibling;
+} trieNode;
+
+/* Sorted names of one directory, reused until the directory's mtime changes */
+/* Keyed by device and inode, so a relative path that names another directory after cd isn't mistaken for it */
+typedef struct dirListing
+{
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char **names;		/* directories carry a trailing '/' */
+    int count;
+    unsigned long lastUse;	/* for evicting the least recently used listing */
+} dirListing;
+
+typedef struct completions
+{
+    char **words;
+    int count;
+    int cap;
+} completions;
+
+static trieNode *commandTrie = NULL;
+static char *indexedPath = NULL;	/* PATH the index was built for */
+static dirListing pathDirs[MAX_PATH_DIRS];	/* executables of each PATH directory */
+static int pathDirCount = 0;
+static dirListing dirCache[DIR_CACHE_SIZE];	/* listings for file name completion */
+static unsigned long useClock = 0;
+static const char * const *builtins = NULL;
+static int builtinCount = 0;
+static int idleFd = -1;		/* watched alongside stdin while waiting for a key */
+static void (*idleHandler)(void *) = NULL;
+static void *idleContext = NULL;
+
+void setBuiltinCommands(const char * const *names, int count)
+{
+    builtins = names;
+    builtinCount = count;
+    /* Rebuilt with the new names on the next Tab */
+    FREE(indexedPath);
+    indexedPath = NULL;
+}
+
+/* ---- trie ---- */
+
+void setIdleHandler(int fd, void (*onReady)(void *), void *context)
+{
+    idleFd = fd;
+    idleHandler = onReady;
+    idleContext = context;
+    /* select can't see what stdio already buffered, so read input a byte at a time like other shells do */
+    setvbuf(stdin, NULL, _IONBF, 0);
+}
+
+static void freeTrie(trieNode *node)
+{
+    while (node) {
+        trieNode *sibling = node->sibling;
+        freeTrie(node->child);
+        free(node);
+        node = sibling;
+    }
+}
+
+static void trieInsert(trieNode **level, const char *word)
+{
+    for (; *word; word++) {
+        while (*level && (*level)->c < *word)
+            level = &(*level)->sibling;
+
+        if (!*level || (*level)->c != *word) {
+            trieNode *node = (trieNode*)calloc(1, sizeof(trieNode));
+            node->c = *word;
+            node->sibling = *level;
+            *level = node;
+        }
+
+        if (!word[1])
+            (*level)->terminal = 1;
+        else
+            level = &(*level)->child;
+    }
+}
+
+/* Returns the node reached by prefix, or NULL if no name starts with it */
+static trieNode *trieFind(trieNode *level, const char *prefix)
+{
+    trieNode *node = NULL;
+
+    for (; *prefix; prefix++) {
+        for (node = level; node && node->c != *prefix; node = node->sibling)
+            ;
+        if (!node)
+            return NULL;
+        level = node->child;
+    }
+
+    return node;
+}
+
+static void addCompletion(completions *found, const char *word, int len)
+{
+    if (found->count == found->cap) {
+        found->cap = found->cap ? found->cap * 2 : 64;
+        found->words = (char**)realloc(found->words, found->cap * sizeof(char*));
+    }
+    found->words[found->count] = (char*)malloc(len + 1);
+    memcpy(found->words[found->count], word, len);
+    found->words[found->count++][len] = 0;
+}
+
+static void freeCompletions(completions *found)
+{
+    int i;
+    for (i = 0; i < found->count; ++i)
+        free(found->words[i]);
+    FREE(found->words);
+}
+
+static void trieCollect(trieNode *level, char *word, int len, int max, completions *found)
+{
+    for (; level && found->count < max; level = level->sibling) {
+        word[len] = level->c;
+        if (level->terminal)
+            addCompletion(found, word, len + 1);
+        trieCollect(level->child, word, len + 1, max, found);
+    }
+}
+
+/* ---- directory listings ---- */
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void freeListing(dirListing *listing)
+{
+    int i;
+    for (i = 0; i < listing->count; ++i)
+        free(listing->names[i]);
+    FREE(listing->names);
+    FREE(listing->path);
+    memset(listing, 0, sizeof(dirListing));
+}
+
+static int sameDirectory(dirListing *listing, struct stat *st)
+{
+    return listing->dev == st->st_dev && listing->ino == st->st_ino;
+}
+
+static int isCurrent(dirListing *listing, struct stat *st)
+{
+    return sameDirectory(listing, st) &&
+        listing->mtime.tv_sec == st->st_mtim.tv_sec && listing->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* Reads path into listing. With executablesOnly, keeps the regular files we may execute */
+static void scanDirectory(dirListing *listing, const char *path, struct stat *dirStat, int executablesOnly)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    struct stat st;
+    int cap = 0;
+
+    freeListing(listing);
+    listing->path = strdup(path);
+    listing->dev = dirStat->st_dev;
+    listing->ino = dirStat->st_ino;
+    listing->mtime = dirStat->st_mtim;
+    if (!dir)
+        return;
+
+    while ( (entry = readdir(dir)) ) {
+        int isDir;
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            isDir = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+
+        if (executablesOnly && (isDir || faccessat(dirfd(dir), entry->d_name, X_OK, 0) != 0))
+            continue;
+
+        if (listing->count == cap) {
+            cap = cap ? cap * 2 : 64;
+            listing->names = (char**)realloc(listing->names, cap * sizeof(char*));
+        }
+        listing->names[listing->count] = (char*)malloc(strlen(entry->d_name) + 2);
+        strcpy(listing->names[listing->count], entry->d_name);
+        if (isDir)
+            strcat(listing->names[listing->count], "/");
+        listing->count++;
+    }
+
+    closedir(dir);
+    qsort(listing->names, listing->count, sizeof(char*), compareNames);
+}
+
+/* Brings the PATH index up to date: only directories that changed, or that a relative entry no longer names, are read again */
+static void refreshCommandIndex(void)
+{
+    const char *path = getenv("PATH");
+    struct stat st;
+    int i, j, changed = 0;
+
+    if (!path)
+        path = "";
+
+    if (!indexedPath || strcmp(indexedPath, path) != 0) {
+        for (i = 0; i < pathDirCount; ++i)
+            freeListing(&pathDirs[i]);
+        pathDirCount = 0;
+        while (*path && pathDirCount < MAX_PATH_DIRS) {
+            int len = strcspn(path, ":");
+            if (len > 0) {
+                pathDirs[pathDirCount].path = strndup(path, len);
+                pathDirs[pathDirCount].mtime.tv_sec = -1;
+                pathDirCount++;
+            }
+            path += len;
+            if (*path == ':')
+                path++;
+        }
+        FREE(indexedPath);
+        indexedPath = strdup(getenv("PATH") ? getenv("PATH") : "");
+        changed = 1;
+    }
+
+    for (i = 0; i < pathDirCount; ++i) {
+        dirListing *listing = &pathDirs[i];
+        if (stat(listing->path, &st) != 0)
+            memset(&st, 0, sizeof(st));
+        if (!isCurrent(listing, &st)) {
+            char *dirPath = strdup(listing->path);
+            scanDirectory(listing, dirPath, &st, 1);
+            free(dirPath);
+            changed = 1;
+        }
+    }
+
+    if (!changed && commandTrie)
+        return;
+
+    freeTrie(commandTrie);
+    commandTrie = NULL;
+    for (i = 0; i < pathDirCount; ++i)
+        for (j = 0; j < pathDirs[i].count; ++j)
+            trieInsert(&commandTrie, pathDirs[i].names[j]);
+    for (i = 0; i < builtinCount; ++i)
+        trieInsert(&commandTrie, builtins[i]);
+}
+
+/* Returns the cached listing of the directory path names, reading it again only if its mtime changed */
+static dirListing *listDirectory(const char *path)
+{
+    dirListing *listing = NULL, *oldest = &dirCache[0];
+    struct stat st;
+    int i;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return NULL;
+
+    for (i = 0; i < DIR_CACHE_SIZE && !listing; ++i) {
+        if (dirCache[i].path && sameDirectory(&dirCache[i], &st))
+            listing = &dirCache[i];
+        else if (dirCache[i].lastUse < oldest->lastUse)
+            oldest = &dirCache[i];
+    }
+
+    if (!listing) {
+        listing = oldest;
+        scanDirectory(listing, path, &st, 0);
+    }
+    else if (!isCurrent(listing, &st))
+        scanDirectory(listing, path, &st, 0);
+
+    listing->lastUse = ++useClock;
+    return listing;
+}
+
+/* ---- completion ---- */
+
+static void completeCommand(const char *prefix, completions *found)
+{
+    char word[PATH_MAX_LEN];
+    trieNode *node;
+    int len = strlen(prefix);
+
+    refreshCommandIndex();
+    if (len >= PATH_MAX_LEN - 1)
+        return;
+
+    if (!*prefix) {
+        trieCollect(commandTrie, word, 0, MAX_LISTED + 1, found);
+        return;
+    }
+
+    if (!(node = trieFind(commandTrie, prefix)))
+        return;
+
+    strcpy(word, prefix);
+    if (node->terminal)
+        addCompletion(found, word, len);
+    trieCollect(node->child, word, len, MAX_LISTED + 1, found);
+}
+
+static void completeFile(const char *prefix, completions *found)
+{
+    const char *slash = strrchr(prefix, '/');
+    const char *base = slash ? slash + 1 : prefix;
+    char dir[PATH_MAX_LEN];
+    dirListing *listing;
+    int lo, hi, baseLen = strlen(base), dirLen = slash ? slash - prefix + 1 : 0;
+
+    if (dirLen >= PATH_MAX_LEN - 1)
+        return;
+    if (dirLen) {
+        memcpy(dir, prefix, dirLen);
+        dir[dirLen] = 0;
+    }
+    else
+        strcpy(dir, ".");
+
+    if (!(listing = listDirectory(dir)))
+        return;
+
+    /* Binary search for the first name not below base */
+    for (lo = 0, hi = listing->count; lo < hi; ) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(listing->names[mid], base) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < listing->count && !strncmp(listing->names[lo], base, baseLen); ++lo) {
+        char word[PATH_MAX_LEN];
+        if (*base != '.' && listing->names[lo][0] == '.')
+            continue;
+        if (snprintf(word, PATH_MAX_LEN, "%.*s%s", dirLen, prefix, listing->names[lo]) < PATH_MAX_LEN)
+            addCompletion(found, word, strlen(word));
+        if (found->count > MAX_LISTED)
+            break;
+    }
+}
+
+/* ---- editing ---- */
+
+typedef struct editState
+{
+    char *buf;
+    int size;		/* capacity of buf, the newline and terminator included */
+    int len;
+    int pos;		/* cursor position in buf */
+    const char *prompt;
+    int lastWasTab;
+} editState;
+
+static void writeOut(const char *str, int len)
+{
+    while (len > 0) {
+        int n = write(STDOUT_FILENO, str, len);
+        if (n <= 0)
+            return;
+        str += n;
+        len -= n;
+    }
+}
+
+static void refreshLine(editState *ed)
+{
+    char move[32];
+
+    writeOut("\r", 1);
+    writeOut(ed->prompt, strlen(ed->prompt));
+    writeOut(ed->buf, ed->len);
+    writeOut("\x1b[K\r", 4);
+    snprintf(move, sizeof(move), "\x1b[%dC", (int)strlen(ed->prompt) + ed->pos);
+    if (strlen(ed->prompt) + ed->pos > 0)
+        writeOut(move, strlen(move));
+}
+
+static void insertText(editState *ed, const char *text, int n)
+{
+    if (ed->len + n > ed->size - 2)
+        n = ed->size - 2 - ed->len;
+    if (n <= 0)
+        return;
+    memmove(ed->buf + ed->pos + n, ed->buf + ed->pos, ed->len - ed->pos);
+    memcpy(ed->buf + ed->pos, text, n);
+    ed->len += n;
+    ed->pos += n;
+}
+
+static void deleteRange(editState *ed, int from, int to)
+{
+    memmove(ed->buf + from, ed->buf + to, ed->len - to);
+    ed->len -= to - from;
+    if (ed->pos > to)
+        ed->pos -= to - from;
+    else if (ed->pos > from)
+        ed->pos = from;
+}
+
+static void setText(editState *ed, const char *text)
+{
+    int n = strlen(text);
+    if (n > 0 && text[n-1] == '\n')
+        n--;
+    if (n > ed->size - 2)
+        n = ed->size - 2;
+    memcpy(ed->buf, text, n);
+    ed->len = ed->pos = n;
+}
+
+/* The word being completed starts after the last space before the cursor */
+/* It is a command name if only spaces, '|' or '&' come before it */
+static void onTab(editState *ed)
+{
+    char word[PATH_MAX_LEN];
+    completions found = {NULL, 0, 0};
+    int start = ed->pos, i, common, isCommand = 1;
+
+    while (start > 0 && ed->buf[start-1] != ' ')
+        start--;
+    for (i = start - 1; i >= 0 && isCommand; --i) {
+        if (ed->buf[i] == '|' || ed->buf[i] == '&')
+            break;
+        if (!isspace((unsigned char)ed->buf[i]))
+            isCommand = 0;
+    }
+    if (ed->pos - start >= PATH_MAX_LEN)
+        return;
+    memcpy(word, ed->buf + start, ed->pos - start);
+    word[ed->pos - start] = 0;
+
+    if (isCommand && !strchr(word, '/'))
+        completeCommand(word, &found);
+    else
+        completeFile(word, &found);
+
+    if (found.count == 0) {
+        writeOut("\a", 1);
+        freeCompletions(&found);
+        return;
+    }
+
+    /* Extend the word to the longest prefix shared by every completion */
+    for (common = strlen(found.words[0]), i = 1; i < found.count; ++i) {
+        int j = 0;
+        while (j < common && found.words[i][j] == found.words[0][j])
+            j++;
+        common = j;
+    }
+
+    if (common > ed->pos - start) {
+        insertText(ed, found.words[0] + (ed->pos - start), common - (ed->pos - start));
+        if (found.count == 1 && found.words[0][common-1] != '/')
+            insertText(ed, " ", 1);
+        ed->lastWasTab = 0;
+    }
+    else if (found.count > 1 && ed->lastWasTab) {
+        /* Second Tab in a row lists the candidates */
+        writeOut("\r\n", 2);
+        for (i = 0; i < found.count && i < MAX_LISTED; ++i) {
+            writeOut(found.words[i], strlen(found.words[i]));
+            writeOut(i + 1 < found.count && i + 1 < MAX_LISTED ? "  " : "\r\n", 2);
+        }
+        if (found.count > MAX_LISTED)
+            writeOut("...\r\n", 5);
+    }
+    else {
+        writeOut("\a", 1);
+        ed->lastWasTab = 1;
+        freeCompletions(&found);
+        return;
+    }
+
+    freeCompletions(&found);
+    refreshLine(ed);
+}
+
+/* Blocks until stdin is readable, running the idle handler each time its descriptor gets ready first */
+static void waitForInput(void)
+{
+    fd_set ready;
+
+    while (idleFd >= 0) {
+        FD_ZERO(&ready);
+        FD_SET(STDIN_FILENO, &ready);
+        FD_SET(idleFd, &ready);
+        if (select((idleFd > STDIN_FILENO ? idleFd : STDIN_FILENO) + 1, &ready, NULL, NULL, NULL) == -1) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        if (FD_ISSET(idleFd, &ready))
+            idleHandler(idleContext);
+        if (FD_ISSET(STDIN_FILENO, &ready))
+            return;
+    }
+}
+
+static int readKey(void)
+{
+    unsigned char c;
+    waitForInput();
+    return read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+/* Handles an escape sequence. Returns the arrow/home/end key as a letter, or 0 */
+static int readEscape(void)
+{
+    int c = readKey(), d;
+
+    if (c != '[' && c != 'O')
+        return 0;
+    if ((c = readKey()) >= '0' && c <= '9') {
+        if ((d = readKey()) != '~')
+            return 0;
+        return c == '3' ? 'D' + 1 : (c == '1' || c == '7') ? 'H' : (c == '4' || c == '8') ? 'F' : 0;
+    }
+    return c;
+}
+
+static char *editLine(editState *ed, char * const *history, int count)
+{
+    int historyIndex = count, c;
+    char *saved = NULL;
+
+    refreshLine(ed);
+    while ( (c = readKey()) != -1 ) {
+        int wasTab = ed->lastWasTab;
+        ed->lastWasTab = 0;
+
+        if (c == KEY_ESC) {
+            switch (readEscape()) {
+                case 'A': c = CTRL('P'); break;
+                case 'B': c = CTRL('N'); break;
+                case 'C': c = CTRL('F'); break;
+                case 'D': c = CTRL('B'); break;
+                case 'E': c = CTRL('D'); if (!ed->len) continue; break;
+                case 'H': c = CTRL('A'); break;
+                case 'F': c = CTRL('E'); break;
+                default: continue;
+            }
+        }
+
+        switch (c) {
+            case '\r':
+            case '\n':
+                FREE(saved);
+                writeOut("\r\n", 2);
+                ed->buf[ed->len++] = '\n';
+                ed->buf[ed->len] = 0;
+                return ed->buf;
+            case CTRL('C'):
+                /* Drop the line, like an interactive shell does */
+                ed->len = ed->pos = 0;
+                writeOut("^C\r\n", 4);
+                break;
+            case CTRL('D'):
+                if (!ed->len) {
+                    FREE(saved);
+                    writeOut("\r\n", 2);
+                    return NULL;
+                }
+                if (ed->pos < ed->len)
+                    deleteRange(ed, ed->pos, ed->pos + 1);
+                break;
+            case KEY_BACKSPACE:
+            case CTRL('H'):
+                if (ed->pos > 0)
+                    deleteRange(ed, ed->pos - 1, ed->pos);
+                break;
+            case '\t':
+                ed->lastWasTab = wasTab;
+                onTab(ed);
+                continue;
+            case CTRL('A'):
+                ed->pos = 0;
+                break;
+            case CTRL('E'):
+                ed->pos = ed->len;
+                break;
+            case CTRL('B'):
+                if (ed->pos > 0)
+                    ed->pos--;
+                break;
+            case CTRL('F'):
+                if (ed->pos < ed->len)
+                    ed->pos++;
+                break;
+            case CTRL('K'):
+                ed->len = ed->pos;
+                break;
+            case CTRL('U'):
+                deleteRange(ed, 0, ed->pos);
+                break;
+            case CTRL('W'): {
+                int start = ed->pos;
+                while (start > 0 && ed->buf[start-1] == ' ')
+                    start--;
+                while (start > 0 && ed->buf[start-1] != ' ')
+                    start--;
+                deleteRange(ed, start, ed->pos);
+                break;
+            }
+            case CTRL('L'):
+                writeOut("\x1b[H\x1b[2J", 7);
+                break;
+            case CTRL('P'):
+            case CTRL('N'): {
+                int next = historyIndex + (c == CTRL('P') ? -1 : 1);
+                if (next < 0 || next > count)
+                    break;
+                /* Remember the line being typed before browsing away from it */
+                if (historyIndex == count) {
+                    FREE(saved);
+                    saved = strndup(ed->buf, ed->len);
+                }
+                historyIndex = next;
+                setText(ed, historyIndex == count ? saved : history[historyIndex]);
+                break;
+            }
+            default:
+                if (isprint(c)) {
+                    char ch = c;
+                    insertText(ed, &ch, 1);
+                }
+                break;
+        }
+        refreshLine(ed);
+    }
+
+    FREE(saved);
+    return NULL;
+}
+
+char *readLine(const char *prompt, char *buf, int size, char * const *history, int count)
+{
+    struct termios original, raw;
+    editState ed;
+    char *result;
+
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &original) == -1) {
+        printf("%s", prompt);
+        fflush(stdout);
+        waitForInput();
+        return fgets(buf, size, stdin);
+    }
+
+    fflush(stdout);
+    raw = original;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    memset(&ed, 0, sizeof(ed));
+    ed.buf = buf;
+    ed.size = size;
+    ed.prompt = prompt;
+    result = editLine(&ed, history, count);
+
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+    return result;
+}
+
+void freeLineEditor(void)
+{
+    int i;
+
+    freeTrie(commandTrie);
+    commandTrie = NULL;
+    for (i = 0; i < pathDirCount; ++i)
+        freeListing(&pathDirs[i]);
+    pathDirCount = 0;
+    for (i = 0; i < DIR_CACHE_SIZE; ++i)
+        freeListing(&dirCache[i]);
+    FREE(indexedPath);
+    indexedPath = NULL;
+}
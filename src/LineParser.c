@@ -10,12 +10,39 @@
 
 #define FREE(X) if(X) free((void*)X)
 
+static int isSubstitutionStart(const char *str)
+{
+    return (str[0] == '$' || str[0] == '<' || str[0] == '>') && str[1] == '(';
+}
+
+const char *findSubstitutionEnd(const char *str)
+{
+    int depth = 0;
+
+    for (; *str; str++) {
+        if (*str == '(')
+            depth++;
+        else if (*str == ')' && --depth == 0)
+            return str;
+    }
+
+    return str;
+}
+
+/* Copies the redirection target at str: a <(...) or >(...) substitution whole, otherwise the first word */
 static char *cloneFirstWord(char *str)
 {
     char *start = NULL;
     char *end = NULL;
     char *word;
 
+    while (*str == ' ')
+        str++;
+    if (isSubstitutionStart(str)) {
+        start = str;
+        end = (char*)findSubstitutionEnd(str+1);
+    }
+
     while (!end) {
         switch (*str) {
             case '>':
@@ -45,11 +72,75 @@ static char *cloneFirstWord(char *str)
     return word;
 }
 
+/* Reports an unbalanced $(...), <(...) or >(...), which would otherwise swallow the rest of the line */
+static int checkSubstitutions(const char *str)
+{
+    for (; *str; str++) {
+        if (isSubstitutionStart(str)) {
+            const char *end = findSubstitutionEnd(str+1);
+            if (!*end) {
+                fprintf(stderr, "syntax error: missing ')' for '%.2s'\n", str);
+                return 0;
+            }
+            str = end;
+        }
+    }
+
+    return 1;
+}
+
+/* Like strpbrk, but skips over $(...), <(...) and >(...) substitutions */
+static char *findOutsideSubstitutions(char *str, const char *accept)
+{
+    for (; *str; str++) {
+        if (isSubstitutionStart(str)) {
+            str = (char*)findSubstitutionEnd(str+1);
+            if (!*str)
+                return NULL;
+        }
+        else if (strchr(accept, *str))
+            return str;
+    }
+
+    return NULL;
+}
+
+/* Like strtok(str, " "), but keeps a substitution inside a single word */
+static char *nextWord(char **cursor)
+{
+    char *str = *cursor;
+    char *start;
+
+    while (*str == ' ')
+        str++;
+
+    if (!*str) {
+        *cursor = str;
+        return NULL;
+    }
+
+    start = str;
+    while (*str && *str != ' ') {
+        if (isSubstitutionStart(str)) {
+            str = (char*)findSubstitutionEnd(str+1);
+            if (!*str)
+                break;
+        }
+        str++;
+    }
+
+    if (*str)
+        *str++ = 0;
+
+    *cursor = str;
+    return start;
+}
+
 static void extractRedirections(char *strLine, cmdLine *pCmdLine)
 {
     char *s = strLine;
 
-    while ( (s = strpbrk(s,"<>")) ) {
+    while ( (s = findOutsideSubstitutions(s,"<>")) ) {
         if (*s == '<') {
             FREE(pCmdLine->inputRedirect);
             pCmdLine->inputRedirect = cloneFirstWord(s+1);
@@ -84,8 +175,7 @@ static int isEmpty(const char *str)
 
 static cmdLine *parseSingleCmdLine(const char *strLine)
 {
-    char *delimiter = " ";
-    char *line, *result;
+    char *line, *cursor, *result;
     
     if (isEmpty(strLine))
       return NULL;
@@ -97,10 +187,11 @@ static cmdLine *parseSingleCmdLine(const char *strLine)
          
     extractRedirections(line, pCmdLine);
     
-    result = strtok( line, delimiter);    
+    cursor = line;
+    result = nextWord(&cursor);
     while( result && pCmdLine->argCount < MAX_ARGUMENTS-1) {
         ((char**)pCmdLine->arguments)[pCmdLine->argCount++] = strClone(result);
-        result = strtok ( NULL, delimiter);
+        result = nextWord(&cursor);
     }
 
     FREE(line);
@@ -111,12 +202,12 @@ static cmdLine* _parseCmdLines(char *line)
 {
 	char *nextStrCmd;
 	cmdLine *pCmdLine;
-	char pipeDelimiter = '|';
+	char *pipeDelimiters = "|";
 	
 	if (isEmpty(line))
 	  return NULL;
 	
-	nextStrCmd = strchr(line , pipeDelimiter);
+	nextStrCmd = findOutsideSubstitutions(line, pipeDelimiters);
 	if (nextStrCmd)
 	  *nextStrCmd = 0;
 	
@@ -130,20 +221,26 @@ static cmdLine* _parseCmdLines(char *line)
 	return pCmdLine;
 }
 
+static void indexCmdLines(cmdLine *head)
+{
+  int idx = 0;
+  for (; head; head = head->next)
+    head->idx = idx++;
+}
+
 cmdLine *parseCmdLines(const char *strLine)
 {
 	char* line, *ampersand;
 	cmdLine *head, *last;
-	int idx = 0;
 	
-	if (isEmpty(strLine))
+	if (isEmpty(strLine) || !checkSubstitutions(strLine))
 	  return NULL;
 	
 	line = strClone(strLine);
 	if (line[strlen(line)-1] == '\n')
 	  line[strlen(line)-1] = 0;
 	
-	ampersand = strchr( line,  '&');
+	ampersand = findOutsideSubstitutions(line, "&");
 	if (ampersand)
 	  *(ampersand) = 0;
 		
@@ -154,14 +251,108 @@ cmdLine *parseCmdLines(const char *strLine)
 	  last->blocking = ampersand? 0:1;
 	}
 	
-	for (last = head; last; last = last->next)
-		last->idx = idx++;
+	indexCmdLines(head);
 			
 	FREE(line);
 	return head;
 }
 
 
+static char *strCloneOrNull(const char *source)
+{
+  return source ? strClone(source) : NULL;
+}
+
+cmdLine *lastCmdLine(cmdLine *pCmdLine)
+{
+  if (!pCmdLine)
+    return NULL;
+
+  while (pCmdLine->next)
+    pCmdLine = pCmdLine->next;
+  return pCmdLine;
+}
+
+cmdLine *cloneCmdLines(const cmdLine *pCmdLine)
+{
+  cmdLine *clone;
+  int i;
+
+  if (!pCmdLine)
+    return NULL;
+
+  clone = (cmdLine*)malloc( sizeof(cmdLine) );
+  memcpy(clone, pCmdLine, sizeof(cmdLine));
+  for (i=0; i<pCmdLine->argCount; ++i)
+    ((char**)clone->arguments)[i] = strClone(pCmdLine->arguments[i]);
+  clone->inputRedirect = strCloneOrNull(pCmdLine->inputRedirect);
+  clone->outputRedirect = strCloneOrNull(pCmdLine->outputRedirect);
+  clone->execPath = strCloneOrNull(pCmdLine->execPath);
+  clone->next = cloneCmdLines(pCmdLine->next);
+
+  return clone;
+}
+
+cmdLine *extendCmdLines(const cmdLine *pCmdLine, const char *strSuffix)
+{
+  char *line, *start, *ampersand;
+  cmdLine *head, *last, *extra;
+  char blocking;
+  int i;
+
+  if (!checkSubstitutions(strSuffix) || !(head = cloneCmdLines(pCmdLine)))
+    return NULL;
+
+  for (last = head; last->next; last = last->next)
+    ;
+  blocking = last->blocking;
+
+  line = strClone(strSuffix);
+  if (*line && line[strlen(line)-1] == '\n')
+    line[strlen(line)-1] = 0;
+
+  if ( (ampersand = findOutsideSubstitutions(line, "&")) ) {
+    *ampersand = 0;
+    blocking = 0;
+  }
+
+  for (start = line; isspace((unsigned char)*start); start++)
+    ;
+
+  if (*start == '|') {
+    last->next = _parseCmdLines(start+1);
+  }
+  else if ( (extra = _parseCmdLines(start)) ) {
+    /* The first parsed command continues the last one: move its words over */
+    for (i=0; i<extra->argCount && last->argCount < MAX_ARGUMENTS-1; ++i) {
+      ((char**)last->arguments)[last->argCount++] = extra->arguments[i];
+      ((char**)extra->arguments)[i] = NULL;
+    }
+    if (extra->inputRedirect) {
+      FREE(last->inputRedirect);
+      last->inputRedirect = extra->inputRedirect;
+      extra->inputRedirect = NULL;
+    }
+    if (extra->outputRedirect) {
+      FREE(last->outputRedirect);
+      last->outputRedirect = extra->outputRedirect;
+      extra->outputRedirect = NULL;
+    }
+    last->next = extra->next;
+    extra->next = NULL;
+    freeCmdLines(extra);
+  }
+
+  last->blocking = 0;
+  while (last->next)
+    last = last->next;
+  last->blocking = blocking;
+  indexCmdLines(head);
+
+  FREE(line);
+  return head;
+}
+
 void freeCmdLines(cmdLine *pCmdLine)
 {
   int i;
@@ -170,6 +361,7 @@ void freeCmdLines(cmdLine *pCmdLine)
 
   FREE(pCmdLine->inputRedirect);
   FREE(pCmdLine->outputRedirect);
+  FREE(pCmdLine->execPath);
   for (i=0; i<pCmdLine->argCount; ++i)
       FREE(pCmdLine->arguments[i]);
 
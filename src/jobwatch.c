@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../include/JobBoard.h"
+
+const char *statusName(int status)
+{
+    switch (status)
+    {
+    case JOB_TERMINATED:
+        return "Terminated";
+    case JOB_SUSPENDED:
+        return "Suspended";
+    case JOB_RUNNING:
+        return "Running";
+    default:
+        return "Unknown";
+    }
+}
+
+void printBoard(const jobBoard *board)
+{
+    jobSlot slot;
+    char started[32];
+
+    printf("%-*s %-*s %-*s %-*s %s\n", 8, "PID", 10, "STATUS", 4, "EXIT", 19, "STARTED", "COMMAND");
+    for (int i = 0; i < JOBBOARD_SLOTS; i++)
+    {
+        if (!readJobSlot(board, i, &slot))
+        {
+            continue;
+        }
+        time_t startTime = (time_t)slot.startTime;
+        strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", localtime(&startTime));
+        if (slot.status == JOB_TERMINATED)
+        {
+            printf("%-*d %-*s %-*d %-*s %s\n", 8, slot.pid, 10, statusName(slot.status),
+                   4, slot.exitCode, 19, started, slot.command);
+        }
+        else
+        {
+            printf("%-*d %-*s %-*s %-*s %s\n", 8, slot.pid, 10, statusName(slot.status),
+                   4, "-", 19, started, slot.command);
+        }
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int interval = 0, count = -1, opt;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i interval_ms] [-n count] board_path\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-i interval_ms] [-n count] board_path\n", argv[0]);
+        return 1;
+    }
+
+    const jobBoard *board = openJobBoard(argv[optind]);
+    if (!board)
+    {
+        return 1;
+    }
+
+    printf("shell %d\n", board->shellPid);
+    printBoard(board);
+    if (interval <= 0)
+    {
+        return 0;
+    }
+
+    /*Polling the generation counter costs no syscalls, only a memory read*/
+    uint32_t seen = __atomic_load_n(&board->generation, __ATOMIC_ACQUIRE);
+    while (count < 0 || --count > 0)
+    {
+        uint32_t generation;
+        while ((generation = __atomic_load_n(&board->generation, __ATOMIC_ACQUIRE)) == seen)
+        {
+            usleep(interval * 1000);
+        }
+        seen = generation;
+        printf("\n");
+        printBoard(board);
+    }
+    return 0;
+}
@@ -1,36 +1,242 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
-#include <sys/syscall.h>
+#include <errno.h>
+#include <time.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/select.h>
+
+#define TICK_MS 10
+#define DEFAULT_LINE_SIZE 64
+#define DRAIN_BUFFER 65536
+
+volatile sig_atomic_t tstpCount = 0, contCount = 0, intCount = 0;
+volatile sig_atomic_t quiet = 0, interrupted = 0;
+char ackTstp[64], ackCont[64], ackInt[64];
 
 void handler(int sig)
 {
-	printf("Recieved Signal : %s\n", strsignal(sig));
+	int savedErrno = errno;
+	char *ack = ackInt;
+
 	if (sig == SIGTSTP)
 	{
-		signal(SIGTSTP, SIG_DFL);
+		tstpCount++;
+		ack = ackTstp;
 	}
 	else if (sig == SIGCONT)
 	{
-		signal(SIGCONT, SIG_DFL);
+		contCount++;
+		ack = ackCont;
 	}
-	signal(sig, SIG_DFL);
-	raise(sig);
+	else
+	{
+		intCount++;
+		interrupted = 1;
+	}
+
+	if (!quiet)
+	{
+		write(STDERR_FILENO, ack, strlen(ack));
+	}
+	if (sig == SIGTSTP)
+	{ /*Really stop, but keep the handler so later signals are still counted*/
+		raise(SIGSTOP);
+	}
+	errno = savedErrno;
+}
+
+void installHandler(int sig, char *ack)
+{
+	struct sigaction sa;
+
+	/*strsignal is not async-signal-safe, so the messages are built up front*/
+	snprintf(ack, 64, "Recieved Signal : %s\n", strsignal(sig));
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(sig, &sa, NULL);
+}
+
+/*Polls with select instead of setting O_NONBLOCK, which would also change the shell's terminal when stdin is shared*/
+int readable(int fd)
+{
+	struct timeval timeout = {0, 0};
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	return select(fd + 1, &fds, NULL, NULL, &timeout) > 0;
+}
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c cpu_percent] [-m megabytes] [-r lines_per_sec] [-l line_bytes] [-i] [-t seconds] [-q]\n", name);
+	fprintf(stderr, "  -c  burn this share of one CPU (0-100)\n");
+	fprintf(stderr, "  -m  allocate and touch this much memory\n");
+	fprintf(stderr, "  -r  write lines to stdout at this rate (0 = as fast as possible)\n");
+	fprintf(stderr, "  -l  size of each line, newline included (default %d)\n", DEFAULT_LINE_SIZE);
+	fprintf(stderr, "  -i  read and drain stdin until EOF\n");
+	fprintf(stderr, "  -t  exit after this many seconds (default: run until interrupted)\n");
+	fprintf(stderr, "  -q  don't acknowledge signals or print the summary\n");
 }
 
 int main(int argc, char **argv)
 {
+	int cpuPercent = 0, rate = -1, lineSize = DEFAULT_LINE_SIZE, drain = 0, opt;
+	double seconds = 0;
+	long megabytes = 0;
+
+	while ((opt = getopt(argc, argv, "c:m:r:l:it:q")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			cpuPercent = atoi(optarg);
+			break;
+		case 'm':
+			megabytes = atol(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'l':
+			lineSize = atoi(optarg);
+			break;
+		case 'i':
+			drain = 1;
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (cpuPercent < 0 || cpuPercent > 100 || lineSize < 1 || megabytes < 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!quiet && rate < 0)
+	{
+		printf("Starting the program\n");
+		fflush(stdout);
+	}
+	installHandler(SIGINT, ackInt);
+	installHandler(SIGTSTP, ackTstp);
+	installHandler(SIGCONT, ackCont);
+
+	char *memory = NULL;
+	if (megabytes > 0)
+	{
+		size_t size = (size_t)megabytes * 1024 * 1024;
+		long page = sysconf(_SC_PAGESIZE);
+		if (!(memory = malloc(size)))
+		{
+			perror("Failed allocating memory");
+			return 1;
+		}
+		for (size_t i = 0; i < size; i += page)
+		{
+			memory[i] = 1;
+		}
+	}
+
+	char *line = malloc(lineSize);
+	memset(line, 'x', lineSize);
+	line[lineSize - 1] = '\n';
+
+	char *drainBuffer = drain ? malloc(DRAIN_BUFFER) : NULL;
 
-	printf("Starting the program\n");
-	signal(SIGINT, handler);
-	signal(SIGTSTP, handler);
-	signal(SIGCONT, handler);
+	double start = now(), tick = TICK_MS / 1000.0;
+	long long linesWritten = 0, bytesRead = 0;
+	volatile unsigned long spin = 0;
 
-	while (1)
+	while (!interrupted)
 	{
-		sleep(1);
+		double tickStart = now();
+		if (seconds > 0 && tickStart - start >= seconds)
+		{
+			break;
+		}
+
+		if (rate >= 0)
+		{ /*Catch up to the requested rate, or fill one tick's worth when unthrottled*/
+			long long due = rate > 0 ? (long long)((tickStart - start) * rate) + 1 - linesWritten : 1024;
+			for (; due > 0; due--, linesWritten++)
+			{
+				if (fwrite(line, 1, lineSize, stdout) != (size_t)lineSize)
+				{
+					interrupted = 1;
+					break;
+				}
+			}
+			fflush(stdout);
+		}
+
+		if (drain)
+		{
+			ssize_t n = -1;
+			while (readable(STDIN_FILENO) && (n = read(STDIN_FILENO, drainBuffer, DRAIN_BUFFER)) > 0)
+			{
+				bytesRead += n;
+			}
+			if (n == 0)
+			{ /*EOF: nothing left to drain*/
+				drain = 0;
+				if (rate < 0 && seconds <= 0 && cpuPercent == 0)
+				{
+					break;
+				}
+			}
+		}
+
+		while (now() - tickStart < tick * cpuPercent / 100)
+		{
+			spin++;
+		}
+
+		if (rate == 0)
+		{
+			continue;
+		}
+		double left = tick - (now() - tickStart);
+		if (left > 0)
+		{
+			struct timeval timeout = {0, (long)(left * 1e6)};
+			fd_set readable;
+			FD_ZERO(&readable);
+			if (drain)
+			{
+				FD_SET(STDIN_FILENO, &readable);
+			}
+			select(drain ? STDIN_FILENO + 1 : 0, &readable, NULL, NULL, &timeout);
+		}
 	}
 
-	return 0;
-}
\ No newline at end of file
+	if (!quiet)
+	{
+		double elapsed = now() - start;
+		fprintf(stderr, "looper: %.2fs, %lld lines written (%.2f MB/s), %lld bytes read (%.2f MB/s), SIGTSTP %d SIGCONT %d SIGINT %d\n",
+				elapsed, linesWritten, linesWritten * (double)lineSize / elapsed / (1024 * 1024),
+				bytesRead, bytesRead / elapsed / (1024 * 1024), (int)tstpCount, (int)contCount, (int)intCount);
+	}
+
+	free(memory);
+	free(line);
+	free(drainBuffer);
+	return interrupted && intCount ? 128 + SIGINT : 0;
+}
@@ -1,40 +1,493 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <sys/wait.h>
 
+#define MIN_SIZE 1
+#define MAX_SIZE (16 * 1024 * 1024)
+#define SIZE_FACTOR 4
+#define BYTES_PER_POINT (64 * 1024 * 1024)
+#define MIN_ITERATIONS 4
+#define MAX_ITERATIONS 20000
 
-int main(int argc, char const *argv[])
+#define MODE_PINGPONG 0
+#define MODE_STREAM 1
+
+typedef struct channel
 {
-    int fd[2];
-    if(pipe(fd) == -1){
-        perror("Piping unsuccessful");
-        return 1;
+    int data[2];          /* data fds: [0] read end (child), [1] write end (parent) */
+    int ack[2];           /* acknowledgement fds: [0] read end (parent), [1] write end (child) */
+    char *shared;         /* shared mapping for the eventfd transport. NULL otherwise */
+} channel;
+
+typedef struct transport
+{
+    const char *name;
+    int (*setup)(channel *ch, size_t maxSize);
+    int (*send)(channel *ch, const char *buf, size_t size);  /* parent side */
+    int (*recv)(channel *ch, char *buf, size_t size);        /* child side */
+    int (*sendAck)(channel *ch);                             /* child side */
+    int (*waitAck)(channel *ch);                             /* parent side */
+} transport;
+
+int writeAll(int fd, const char *buf, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, buf, size);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int readAll(int fd, char *buf, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = read(fd, buf, size);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* ---- acknowledgements over a plain pipe, shared by most transports ---- */
+
+int pipeAckSetup(channel *ch)
+{
+    return pipe(ch->ack);
+}
+
+int pipeSendAck(channel *ch)
+{
+    return writeAll(ch->ack[1], "!", 1);
+}
+
+int pipeWaitAck(channel *ch)
+{
+    char ack;
+    return readAll(ch->ack[0], &ack, 1);
+}
+
+/* ---- pipe: write() / read() ---- */
+
+int pipeSetup(channel *ch, size_t maxSize)
+{
+    if (pipe(ch->data) == -1)
+    {
+        return -1;
     }
-    
+    return pipeAckSetup(ch);
+}
+
+int pipeSend(channel *ch, const char *buf, size_t size)
+{
+    return writeAll(ch->data[1], buf, size);
+}
+
+int fdRecv(channel *ch, char *buf, size_t size)
+{
+    return readAll(ch->data[0], buf, size);
+}
+
+/* ---- pipe with vmsplice(): pages are mapped into the pipe instead of copied ---- */
+
+/*Without SPLICE_F_GIFT the pipe references sendBuf's pages, so a real sender could not touch the buffer
+  until the reader consumed them. Here the next message is sent from the same buffer right away, which is
+  only correct because it always holds the same 'x' bytes: stream mode vmsplice results are an upper bound*/
+int vmspliceSend(channel *ch, const char *buf, size_t size)
+{
+    while (size > 0)
+    {
+        struct iovec iov = {(void *)buf, size};
+        ssize_t n = vmsplice(ch->data[1], &iov, 1, 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* ---- socketpair: AF_UNIX stream socket ---- */
+
+int socketSetup(channel *ch, size_t maxSize)
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ch->data) == -1)
+    {
+        return -1;
+    }
+    return pipeAckSetup(ch);
+}
+
+/* ---- eventfd + shared memory: the message is copied into a shared mapping ---- */
+
+int eventfdSetup(channel *ch, size_t maxSize)
+{
+    ch->shared = mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ch->shared == MAP_FAILED)
+    {
+        ch->shared = NULL;
+        return -1;
+    }
+    ch->data[0] = ch->data[1] = eventfd(0, 0);
+    ch->ack[0] = ch->ack[1] = eventfd(0, 0);
+    return (ch->data[0] == -1 || ch->ack[0] == -1) ? -1 : 0;
+}
+
+int eventfdSend(channel *ch, const char *buf, size_t size)
+{
+    memcpy(ch->shared, buf, size);
+    return eventfd_write(ch->data[1], 1);
+}
+
+int eventfdRecv(channel *ch, char *buf, size_t size)
+{
+    eventfd_t value;
+    if (eventfd_read(ch->data[0], &value) == -1)
+    {
+        return -1;
+    }
+    memcpy(buf, ch->shared, size);
+    return 0;
+}
+
+int eventfdSendAck(channel *ch)
+{
+    return eventfd_write(ch->ack[1], 1);
+}
+
+int eventfdWaitAck(channel *ch)
+{
+    eventfd_t value;
+    return eventfd_read(ch->ack[0], &value);
+}
+
+/* ---- memfd handoff: each message is a sealed memfd passed with SCM_RIGHTS ---- */
+
+int sendFd(int socket, int fd)
+{
+    char byte = 0, control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(socket, &msg, 0) == 1 ? 0 : -1;
+}
+
+int recvFd(int socket)
+{
+    char byte, control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+    int fd;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket, &msg, 0) != 1)
+    {
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return -1;
+    }
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+int memfdSend(channel *ch, const char *buf, size_t size)
+{
+    int fd = memfd_create("mypipe", MFD_ALLOW_SEALING);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    char *map = ftruncate(fd, size) == -1 ? MAP_FAILED : mmap(NULL, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+    memcpy(map, buf, size);
+    munmap(map, size);
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    int result = sendFd(ch->data[1], fd);
+    close(fd);
+    return result;
+}
+
+int memfdRecv(channel *ch, char *buf, size_t size)
+{
+    int fd = recvFd(ch->data[0]);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+    memcpy(buf, map, size);
+    munmap(map, size);
+    return 0;
+}
+
+transport transports[] = {
+    {"pipe", pipeSetup, pipeSend, fdRecv, pipeSendAck, pipeWaitAck},
+    {"vmsplice", pipeSetup, vmspliceSend, fdRecv, pipeSendAck, pipeWaitAck},
+    {"socketpair", socketSetup, pipeSend, fdRecv, pipeSendAck, pipeWaitAck},
+    {"eventfd", eventfdSetup, eventfdSend, eventfdRecv, eventfdSendAck, eventfdWaitAck},
+    {"memfd", socketSetup, memfdSend, memfdRecv, pipeSendAck, pipeWaitAck},
+};
+
+#define TRANSPORT_COUNT (int)(sizeof(transports) / sizeof(transports[0]))
+
+/*Closes both ends of a pair, which may be one fd, skipping the ones a failed setup never opened*/
+void closePair(int fds[2])
+{
+    if (fds[0] >= 0)
+    {
+        close(fds[0]);
+    }
+    if (fds[1] >= 0 && fds[1] != fds[0])
+    {
+        close(fds[1]);
+    }
+}
+
+/*Closes the end of a pair this process doesn't use, so it sees EOF or EPIPE once the other process is gone.
+  The eventfd transport uses one fd for both ends and keeps it*/
+void keepEnd(int fds[2], int keep)
+{
+    if (fds[0] != fds[1] && fds[!keep] >= 0)
+    {
+        close(fds[!keep]);
+        fds[!keep] = -1;
+    }
+}
+
+void closeChannel(channel *ch, size_t maxSize)
+{
+    closePair(ch->data);
+    closePair(ch->ack);
+    if (ch->shared)
+    {
+        munmap(ch->shared, maxSize);
+    }
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*Ping-pong acknowledges every message; streaming only the last one.
+  The eventfd transport reuses one shared buffer, so it always acknowledges every message.*/
+int needsAck(transport *t, int mode, int i, int iterations)
+{
+    return mode == MODE_PINGPONG || t->send == eventfdSend || i == iterations - 1;
+}
+
+int measure(transport *t, int mode, size_t size, int iterations, char *sendBuf, char *recvBuf, double *elapsed)
+{
+    channel ch = {{-1, -1}, {-1, -1}, NULL};
+    if (t->setup(&ch, size) == -1)
+    {
+        perror(t->name);
+        closeChannel(&ch, size);
+        return -1;
+    }
+
     pid_t pid = fork();
-    
     if (pid == 0)
-    { /*Child process*/
-        close(fd[0]);
-        char *randomString = "Hello parent!";
-        printf("Child: Sending parent: %s\n", randomString);
-        
-        write(fd[1], randomString, strlen(randomString) + 1);
-        close(fd[1]);
-    }
-    else
-    {/*Parent process*/
-        close(fd[1]);
-        char fromChild[1024];
-        
-        read(fd[0], fromChild, 1024);
-        printf("Parent: Got from child: %s\n", fromChild);
-        
-        close(fd[0]);
-        waitpid(pid, NULL, WUNTRACED);
-    }
-    
+    { /*Child process: receiver*/
+        keepEnd(ch.data, 0);
+        keepEnd(ch.ack, 1);
+        if (t->sendAck(&ch) == -1) /*ready*/
+        {
+            _exit(1);
+        }
+        for (int i = 0; i < iterations; i++)
+        {
+            if (t->recv(&ch, recvBuf, size) == -1)
+            {
+                _exit(1);
+            }
+            if (needsAck(t, mode, i, iterations) && t->sendAck(&ch) == -1)
+            {
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    /*Parent process: sender*/
+    int status, result = 0;
+    keepEnd(ch.data, 1);
+    keepEnd(ch.ack, 0);
+    result = t->waitAck(&ch);
+    double start = now();
+    for (int i = 0; i < iterations && result == 0; i++)
+    {
+        result = t->send(&ch, sendBuf, size);
+        if (result == 0 && needsAck(t, mode, i, iterations))
+        {
+            result = t->waitAck(&ch);
+        }
+    }
+    *elapsed = now() - start;
+
+    closeChannel(&ch, size);
+    waitpid(pid, &status, 0);
+    if (result == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "%s: transfer of %zu bytes failed\n", t->name, size);
+        return -1;
+    }
     return 0;
 }
 
+void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t transport] [-s min_bytes] [-S max_bytes] [-f factor] [-b bytes_per_point]\n", name);
+    fprintf(stderr, "transports:");
+    for (int i = 0; i < TRANSPORT_COUNT; i++)
+    {
+        fprintf(stderr, " %s", transports[i].name);
+    }
+    fprintf(stderr, " (default: all)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    size_t minSize = MIN_SIZE, maxSize = MAX_SIZE, budget = BYTES_PER_POINT;
+    int factor = SIZE_FACTOR, opt;
+
+    while ((opt = getopt(argc, argv, "t:s:S:f:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            only = optarg;
+            break;
+        case 's':
+            minSize = strtoul(optarg, NULL, 10);
+            break;
+        case 'S':
+            maxSize = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            factor = atoi(optarg);
+            break;
+        case 'b':
+            budget = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (minSize < 1 || maxSize < minSize || factor < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *sendBuf = malloc(maxSize), *recvBuf = malloc(maxSize);
+    if (!sendBuf || !recvBuf)
+    {
+        perror("malloc");
+        return 1;
+    }
+    memset(sendBuf, 'x', maxSize);
+    memset(recvBuf, 0, maxSize); /*fault the pages in before the child inherits them*/
+
+    /*A receiver that died makes the sender's write fail with EPIPE instead of killing the benchmark*/
+    signal(SIGPIPE, SIG_IGN);
+    printf("transport,mode,bytes,iterations,seconds,latency_us,throughput_MBps\n");
+    for (int t = 0; t < TRANSPORT_COUNT; t++)
+    {
+        if (only && strcmp(only, transports[t].name) != 0)
+        {
+            continue;
+        }
+        for (size_t size = minSize; size <= maxSize; size *= factor)
+        {
+            size_t perPoint = budget / size;
+            int iterations = perPoint < MIN_ITERATIONS ? MIN_ITERATIONS :
+                             perPoint > MAX_ITERATIONS ? MAX_ITERATIONS : (int)perPoint;
+            for (int mode = MODE_PINGPONG; mode <= MODE_STREAM; mode++)
+            {
+                double elapsed;
+                if (measure(&transports[t], mode, size, iterations, sendBuf, recvBuf, &elapsed) == -1)
+                {
+                    continue;
+                }
+                printf("%s,%s,%zu,%d,%.6f,%.3f,%.2f\n", transports[t].name,
+                       mode == MODE_PINGPONG ? "pingpong" : "stream", size, iterations, elapsed,
+                       elapsed / iterations * 1e6, (double)size * iterations / elapsed / (1024 * 1024));
+                fflush(stdout);
+            }
+            if (size > maxSize / factor)
+            {
+                break;
+            }
+        }
+    }
+
+    free(sendBuf);
+    free(recvBuf);
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -5,46 +6,151 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <time.h>
+#include <termios.h>
 #include <linux/limits.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include "../include/LineParser.h"
+#include "../include/JobBoard.h"
+#include "../include/LineEditor.h"
 
 #define TERMINATED -1
 #define RUNNING 1
 #define SUSPENDED 0
 #define HISTLEN 20
 #define INPUT_MAX 2048
+#define CAPTURE_CHUNK 65536
+#define PLACE_NONE 0
+#define PLACE_COMPACT 1
+#define PLACE_SPREAD 2
+#define PLACE_ROUNDROBIN 3
+#define MAX_NODES 64
+#define CPULIST_MAX 256
+#define MAX_SUBSTITUTIONS 16
+#define SUBST_INPUT -1
+#define SUBST_OUTPUT -2
+#define BENCH_RUNS 10
+#define BENCH_WARMUP 1
+#define BENCH_MAX_RUNS 100000
 
 typedef struct process
 {
     cmdLine *cmd;         /* the parsed command line*/
     pid_t pid;            /* the process id that is running the command*/
     int status;           /* status of the process: RUNNING/SUSPENDED/TERMINATED */
+    int exitCode;         /* exit status (128+signal if killed), valid once TERMINATED */
+    int termSignal;       /* signal that killed the process, 0 if it exited */
+    cpu_set_t cpus;       /* CPUs the process was allowed to run on when launched */
+    int jobId;            /* the job (command line) the process belongs to */
+    pid_t pgid;           /* process group of the job, 0 when the shell is not interactive and runs no job control */
     struct process *next; /* next process in chain */
 } process;
 
+typedef struct captureBuffer
+{
+    char *data;           /* captured bytes, kept 0-terminated */
+    size_t len;           /* number of bytes captured */
+    size_t cap;           /* allocated size of data */
+} captureBuffer;
+
+typedef struct expansion
+{
+    char **argv;          /* arguments after substitution, NULL-terminated */
+    int argc;
+    int argCap;
+    char **blocks;        /* captured outputs the arguments point into */
+    int blockCount;
+    int blockCap;
+} expansion;
+
+typedef struct procSubstitution
+{
+    int idx;              /* index of the command (in the chain) whose argument is replaced */
+    int arg;              /* index of the replaced <(...) or >(...) argument, or SUBST_INPUT/SUBST_OUTPUT for a redirection */
+    int fd;               /* the command's end of the pipe, passed to it as /dev/fd/N or as its stdin/stdout */
+    pid_t pid;            /* the process running the substituted command line */
+} procSubstitution;
+
+typedef struct historyEntry
+{
+    char *line;           /* the command line as it was typed */
+    cmdLine *cmd;         /* its parsed chain with resolved paths, shared by every replay and never modified */
+} historyEntry;
+
+typedef struct terminal
+{
+    int interactive;      /* stdin is a terminal, so foreground jobs are handed its control */
+    pid_t shellPgid;      /* the shell's own process group, which takes the terminal back */
+    struct termios modes; /* the shell's terminal settings, restored after a foreground job */
+} terminal;
+
+typedef struct jobLaunch
+{
+    int id;               /* job ID used by jobs, fg and bg */
+    pid_t pgid;           /* process group of the job, 0 until its first process is forked or without job control */
+    int foreground;       /* the job gets the terminal and the shell waits for it */
+    terminal *term;
+} jobLaunch;
+
+typedef struct childWatch
+{
+    int fds[2];             /* self-pipe the SIGCHLD handler writes to, watched by readLine */
+    process **process_list; /* where the children that signalled are looked up */
+    jobBoard *board;
+} childWatch;
+
+typedef struct placement
+{
+    int policy;                 /* PLACE_NONE/PLACE_COMPACT/PLACE_SPREAD/PLACE_ROUNDROBIN */
+    cpu_set_t allowed;          /* CPUs jobs may be placed on */
+    int cursor;                 /* next CPU index for PLACE_ROUNDROBIN */
+    int jobCount;               /* number of jobs placed so far, used by PLACE_SPREAD */
+    int nodeCount;              /* number of NUMA nodes, 0 until discovered */
+    cpu_set_t nodes[MAX_NODES]; /* CPUs of each NUMA node */
+} placement;
+
+/*The name of the command being run, skipping an "affinity <cpulist>" prefix*/
+const char *commandName(cmdLine *cmd)
+{
+    if (cmd->idx == 0 && cmd->argCount > 2 && strcmp(cmd->arguments[0], "affinity") == 0)
+    {
+        return cmd->arguments[2];
+    }
+    return cmd->arguments[0];
+}
+
 cmdLine * cmdSemiCopy(cmdLine *origin)
 {
-    cmdLine *copy = (cmdLine *)malloc(sizeof(cmdLine));
-    char *prompt = malloc(32);
-    ((char**)copy->arguments)[0] = strcpy(prompt, origin->arguments[0]);
+    cmdLine *copy = (cmdLine *)calloc(1, sizeof(cmdLine));
+    ((char**)copy->arguments)[0] = strdup(commandName(origin));
+    copy->argCount = 1;
     return copy;
 }
 
-process * makeProcess(cmdLine *recievedCmd, pid_t recievedPid)
+process * makeProcess(cmdLine *recievedCmd, pid_t recievedPid, cpu_set_t *cpus, int jobId, pid_t pgid)
 {
     process *newProc = (struct process *)malloc(sizeof(struct process));
     newProc->cmd = cmdSemiCopy(recievedCmd);
     newProc->next = NULL;
     newProc->pid = recievedPid;
     newProc->status = RUNNING;
+    newProc->exitCode = 0;
+    newProc->termSignal = 0;
+    newProc->cpus = *cpus;
+    newProc->jobId = jobId;
+    newProc->pgid = pgid;
     return newProc;
 }
 
-void addProcess(process **process_list, cmdLine *recievedCmd, pid_t recievedPid)
+void addProcess(process **process_list, cmdLine *recievedCmd, pid_t recievedPid, cpu_set_t *cpus, int jobId, pid_t pgid)
 {
-    process *toAdd = makeProcess(recievedCmd, recievedPid);
+    process *toAdd = makeProcess(recievedCmd, recievedPid, cpus, jobId, pgid);
     if (!(*process_list))
     {
         *process_list = toAdd;
@@ -112,12 +218,19 @@ void freeProcessList(process **process_list)
     process *current = *process_list;
     while (current)
     {
+        process *next_process = current->next;
+        freeCmdLines(current->cmd);
         free(current);
-        current = current->next;
+        current = next_process;
     }
 }
 
-void updateProcessStatus(process **process_list, pid_t toChange, int new_status)
+int exitCodeOf(int waitStatus)
+{
+    return WIFSIGNALED(waitStatus) ? 128 + WTERMSIG(waitStatus) : WEXITSTATUS(waitStatus);
+}
+
+void updateProcessStatus(process **process_list, pid_t toChange, int new_status, int exitCode, jobBoard *board)
 {
     process *current = *process_list;
     while (current)
@@ -125,21 +238,35 @@ void updateProcessStatus(process **process_list, pid_t toChange, int new_status)
         if (current->pid == toChange)
         {
             current->status = new_status;
+            if (new_status == TERMINATED)
+            {
+                current->exitCode = exitCode;
+            }
+            publishJob(board, current->pid, current->status, current->exitCode);
         }
         current = current->next;
     }
 }
 
-void updateProcessList(process **process_list)
+void updateProcessList(process **process_list, jobBoard *board)
 {
     process *current = *process_list;
     while (current)
     {
-        int currentStatus;
-        int result = waitpid(current->pid, &currentStatus, WNOHANG | WUNTRACED);
+        int currentStatus, exitCode = current->exitCode;
+        if (current->status == TERMINATED)
+        {/*Reaped already, its pid may belong to someone else by now*/
+            current = current->next;
+            continue;
+        }
+        int result = waitpid(current->pid, &currentStatus, WNOHANG | WUNTRACED | WCONTINUED);
         if (result == 0)
-        {
-            currentStatus = RUNNING;
+        {/*No change since the last report: a stop is reported only once*/
+            currentStatus = current->status;
+        }
+        else if (result == -1)
+        {/*Already reaped by a blocking wait*/
+            currentStatus = TERMINATED;
         }
         else
         {
@@ -153,37 +280,154 @@ void updateProcessList(process **process_list)
             }
             else if (WIFEXITED(currentStatus) || WIFSIGNALED(currentStatus))
             {
+                exitCode = exitCodeOf(currentStatus);
+                current->termSignal = WIFSIGNALED(currentStatus) ? WTERMSIG(currentStatus) : 0;
                 currentStatus = TERMINATED;
             }
         }
 
         if (currentStatus != current->status)
         {
-            updateProcessStatus(process_list, current->pid, currentStatus);
+            updateProcessStatus(process_list, current->pid, currentStatus, exitCode, board);
         }
         current = current->next;
     }
 }
 
+/*The SIGCHLD handler can only reach the self-pipe through a global*/
+int childEventFd = -1;
+
+void onChildSignal(int sig)
+{
+    int savedErrno = errno;
+    /*If the pipe is full, readLine has a wakeup pending already*/
+    write(childEventFd, "", 1);
+    errno = savedErrno;
+}
+
+/*Called by readLine while the shell waits for input, so jobs that end meanwhile are reaped and published
+  instead of staying zombies shown as Running until the next command*/
+void onChildEvents(void *context)
+{
+    childWatch *watch = context;
+    char drain[64];
+    while (read(watch->fds[0], drain, sizeof(drain)) > 0)
+        ;
+    updateProcessList(watch->process_list, watch->board);
+}
+
+/*The handler only wakes readLine up: reaping stays with the code that waits, so blocking waits for a job still see it*/
+void watchChildren(childWatch *watch, process **process_list, jobBoard *board)
+{
+    watch->process_list = process_list;
+    watch->board = board;
+    if (pipe2(watch->fds, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        perror("Failed creating the child event pipe");
+        return;
+    }
+    childEventFd = watch->fds[1];
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onChildSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+    setIdleHandler(watch->fds[0], onChildEvents, watch);
+}
+
+int parseCpuList(const char *list, cpu_set_t *cpus)
+{
+    char *end;
+    CPU_ZERO(cpus);
+    while (*list)
+    {
+        long first = strtol(list, &end, 10), last;
+        if (end == list || first < 0)
+        {
+            return 0;
+        }
+        last = first;
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+            {
+                return 0;
+            }
+        }
+        if (last >= CPU_SETSIZE)
+        {
+            return 0;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end)
+        {
+            return 0;
+        }
+        list = end;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+void formatCpuList(cpu_set_t *cpus, char *list, int size)
+{
+    int len = 0;
+    list[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < size; cpu++)
+    {
+        if (!CPU_ISSET(cpu, cpus))
+        {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+        {
+            last++;
+        }
+        if (last == cpu)
+        {
+            len += snprintf(list + len, size - len, "%s%d", len ? "," : "", cpu);
+        }
+        else
+        {
+            len += snprintf(list + len, size - len, "%s%d-%d", len ? "," : "", cpu, last);
+        }
+        cpu = last;
+    }
+}
+
 void printProcess(process *proc)
 {
     char *status = intToStatus(proc->status);
-    printf("%-*d %-*s   %-*s\n", 8, proc->pid,
+    char cpus[CPULIST_MAX];
+    formatCpuList(&proc->cpus, cpus, CPULIST_MAX);
+    printf("%-*d %-*s   %-*s %s\n", 8, proc->pid,
            8, proc->cmd->arguments[0],
-           8, status);
+           8, status, cpus);
     free(status);
 }
 
-process *removeProcess(process **process_list, process * procToRemove)
+process *removeProcess(process **process_list, process * procToRemove, jobBoard *board)
 {
     removeProcessFromList(process_list, procToRemove->pid);
+    retireJob(board, procToRemove->pid);
     process *next_proc = procToRemove->next;
     freeCmdLines(procToRemove->cmd); /*it's a copy anyway*/
     free(procToRemove);
     return next_proc;
 }
 
-void printProcessListAndDeleteIfTerminated(process **process_list)
+void printProcessListAndDeleteIfTerminated(process **process_list, jobBoard *board)
 {
     process *current = *process_list;
     while (current)
@@ -191,7 +435,7 @@ void printProcessListAndDeleteIfTerminated(process **process_list)
         printProcess(current);
         if (current->status == TERMINATED)
         {
-            current = removeProcess(process_list, current);
+            current = removeProcess(process_list, current, board);
         }
         else
         {
@@ -200,328 +444,1718 @@ void printProcessListAndDeleteIfTerminated(process **process_list)
     }
 }
 
-void onProcs(process **process_list)
+void onProcs(process **process_list, jobBoard *board)
 {
-    printf("%-*s %-*s   %-*s\n", 8, "PID", 8, "Command", 8, "STATUS");
-    updateProcessList(process_list);
-    printProcessListAndDeleteIfTerminated(process_list);
+    printf("%-*s %-*s   %-*s %s\n", 8, "PID", 8, "Command", 8, "STATUS", "CPUS");
+    updateProcessList(process_list, board);
+    printProcessListAndDeleteIfTerminated(process_list, board);
 }
 
-char containsDebugFlag(int argc, char const *argv[])
+void initTerminal(terminal *term)
 {
-    for (int i = 1; i < argc; i++)
+    pid_t owner;
+    term->interactive = isatty(STDIN_FILENO);
+    term->shellPgid = getpgrp();
+    if (!term->interactive)
     {
-        if (strcmp(argv[i], "-d") == 0)
-            return 1;
+        return;
     }
-    return 0;
-}
 
-int isExclamation(char *input)
-{
-    if (strlen(input) < 3 || input[0] != '!') {
-        return -1;
+    /*Started in the background: wait until the terminal is handed to us*/
+    while ((owner = tcgetpgrp(STDIN_FILENO)) != -1 && owner != getpgrp())
+    {
+        kill(-getpgrp(), SIGTTIN);
     }
-    if (input[1] == '!' && (input[2] == ' ' || input[2] == '\n'))
+    if (owner == -1)
     {
-        return 0;
+        term->interactive = 0;
+        return;
     }
-    int i;
-    char num[MAX_INPUT];
-    for (i = 1; i < strlen(input); i++) 
+
+    /*Ctrl-C and Ctrl-Z are meant for the foreground job, not for the shell*/
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    setpgid(0, 0);
+    term->shellPgid = getpgrp();
+    tcsetpgrp(STDIN_FILENO, term->shellPgid);
+    tcgetattr(STDIN_FILENO, &term->modes);
+}
+
+int nextJobId(process *process_list)
+{
+    int id = 0;
+    for (; process_list; process_list = process_list->next)
     {
-        if (!isdigit(input[i])) 
+        if (process_list->jobId > id)
         {
-            if (input[i] == ' ' || input[i] == '\n')
-            {
-                break;
-            }
-            return -1;
+            id = process_list->jobId;
         }
-        
-        num[i - 1] = input[i];
     }
-    return atoi(num);
+    return id + 1;
 }
 
-
-int handleSpecialCommands(cmdLine *cmd, process **process_list)
+/*Runs in every child of a job, before its streams are redirected: joins the job's process group
+  (a new one when it is the first process), takes the terminal for a foreground job and restores the signals the shell ignores.
+  Without a terminal there is no job control, the children stay in the shell's group like in other shells*/
+void enterJob(jobLaunch *job)
 {
-    if (strcmp(cmd->arguments[0], "cd") == 0)
+    if (!job->term->interactive)
     {
-        if (chdir(cmd->arguments[1]) == -1)
-            perror("cd failed");
-        return 1;
+        return;
     }
-    if (strcmp(cmd->arguments[0], "suspend") == 0)
+    pid_t pgid = job->pgid ? job->pgid : getpid();
+    setpgid(0, pgid);
+    if (job->foreground)
     {
-        if (cmd->argCount > 1)
-        {
-            int toStop = atoi(cmd->arguments[1]);
-            kill(toStop, SIGTSTP);
-            usleep(10000);
-        }
-        return 1;
+        tcsetpgrp(STDIN_FILENO, pgid);
     }
-    if (strcmp(cmd->arguments[0], "wake") == 0)
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+}
+
+/*The parent's half of enterJob, so the group exists whichever of the two runs first*/
+void joinJob(jobLaunch *job, pid_t pid)
+{
+    if (!job->term->interactive)
     {
-        if (cmd->argCount > 1)
-        {
-            int toContinue = atoi(cmd->arguments[1]);
-            kill(toContinue, SIGCONT);
-            usleep(10000);
-        }
-        return 1;
+        return;
     }
-    if (strcmp(cmd->arguments[0], "kill") == 0)
+    if (!job->pgid)
     {
-        if (cmd->argCount > 1)
-        {
-            int toTerminate = atoi(cmd->arguments[1]);
-            kill(toTerminate, SIGINT);
-            usleep(10000);
-        }
-        return 1;
+        job->pgid = pid;
     }
-    if (strcmp(cmd->arguments[0], "procs") == 0)
+    setpgid(pid, job->pgid);
+    if (job->foreground)
     {
-        onProcs(process_list);
-        usleep(10000);
-        return 1;
+        tcsetpgrp(STDIN_FILENO, job->pgid);
     }
-
-    return 0;
 }
 
-void freeHistory(char** history) {
-    for (int i = 0; i < HISTLEN; i++) {
-        free(history[i]);
+process *firstWithStatus(process *process_list, int jobId, int status)
+{
+    while (process_list && (process_list->jobId != jobId || process_list->status != status))
+    {
+        process_list = process_list->next;
     }
+    return process_list;
 }
 
-void addHistoryLine(char **history, int *newest, int *oldest, char* line)
+int jobHasStatus(process *process_list, int jobId, int status)
 {
-    if (*newest < 0 && *oldest < 0)
-    {/*History is empty*/
-        *newest = 0, *oldest = 0;
-    }
-    else
+    return firstWithStatus(process_list, jobId, status) != NULL;
+}
+
+void setJobStatus(process **process_list, int jobId, int status, jobBoard *board)
+{
+    for (process *current = *process_list; current; current = current->next)
     {
-        *newest = (*newest + 1) % HISTLEN;
-        if (*newest == *oldest) 
+        if (current->jobId == jobId && current->status != TERMINATED)
         {
-            free(history[*oldest]);
-            *oldest = (*oldest + 1) % HISTLEN;
+            updateProcessStatus(process_list, current->pid, status, 0, board);
         }
     }
-    history[*newest] = line;
 }
 
-void printHistory(char **history, int *newest, int *oldest)
+process *firstOfJob(process *process_list, int jobId)
 {
-    for (int i = *oldest; i <= *newest; i++) {
-        printf("%d. %s", i + 1, history[i]);
+    while (process_list && process_list->jobId != jobId)
+    {
+        process_list = process_list->next;
     }
+    return process_list;
 }
 
-void insertLastCmd(char *input, char *lastCmd)
+void printJob(process *process_list, process *job)
 {
-    lastCmd[strlen(lastCmd) - 1] = '\0';
-    strcat(lastCmd, input + 2);
-    strcpy(input, lastCmd);
+    int status = jobHasStatus(process_list, job->jobId, RUNNING) ? RUNNING
+                 : jobHasStatus(process_list, job->jobId, SUSPENDED) ? SUSPENDED : TERMINATED;
+    char *statusString = intToStatus(status);
+    printf("[%d] %-*d %-*s ", job->jobId, 8, job->pid, 10, statusString);
+    free(statusString);
+    for (process *current = job; current; current = current->next)
+    {
+        if (current->jobId == job->jobId)
+        {
+            printf("%s%s", current == job ? "" : " | ", current->cmd->arguments[0]);
+        }
+    }
+    printf("\n");
 }
 
-int insertNumCmd(char *input, char **history, int oldest, int index)
+/*Finds the first process of the job named by "%n" or by the pid of one of its processes.
+  Without a spec it is the most recent job that didn't terminate*/
+process *findJob(process *process_list, const char *spec)
 {
+    process *found = NULL;
+    int jobId = spec && spec[0] == '%' ? atoi(spec + 1) : 0;
+    pid_t pid = spec && spec[0] != '%' ? atoi(spec) : 0;
 
-    char *lineFromHistory = history[(oldest + index - 1) % 20];
-    if (index > HISTLEN || !lineFromHistory)
-    {
-        printf("History is too short\n");
-        return 0;
-    }
-    else
+    for (process *current = process_list; current; current = current->next)
     {
-        char toInsert[strlen(lineFromHistory)];
-        strcpy(toInsert, lineFromHistory);
-        toInsert[strlen(toInsert) - 1] = '\0';
-        
-        char *suffix = strchr(input, ' ');
-        if (!suffix)
+        if (!spec && current->status != TERMINATED && (!found || current->jobId > found->jobId))
         {
-            suffix = strchr(input, '\n');
+            found = current;
+        }
+        else if (spec && (jobId ? current->jobId == jobId : current->pid == pid))
+        {
+            found = current;
+            break;
         }
-        
-        strcat(toInsert, suffix);
-        strcpy(input, toInsert);
-        return 1;
     }
-}    
+    return found ? firstOfJob(process_list, found->jobId) : NULL;
+}
 
-void execute(cmdLine *pCmdLine)
+/*One killpg reaches the whole job. Without job control its processes share the shell's group, so each gets its own kill*/
+int signalJobProcesses(process *process_list, process *job, int sig)
 {
-    if (execvp(pCmdLine->arguments[0], pCmdLine->arguments) == -1)
+    if (job->pgid)
     {
-        perror("Failed command execution");
-        exit(1);
+        return killpg(job->pgid, sig);
     }
+    int result = 0;
+    for (process *current = process_list; current; current = current->next)
+    {
+        if (current->jobId == job->jobId && current->status != TERMINATED && kill(current->pid, sig) == -1)
+        {
+            result = -1;
+        }
+    }
+    return result;
 }
 
-
-int main(int argc, char const *argv[])
+/*Waits until no process of the foreground job runs anymore, either all finished or Ctrl-Z stopped them.
+  Returns the exit code of lastPid (128+signal if it got stopped) after taking the terminal back*/
+int waitForJob(process **process_list, int jobId, pid_t lastPid, terminal *term, jobBoard *board)
 {
-    struct process *processList;
-    char debug = containsDebugFlag(argc, argv);
-    char *history[HISTLEN];
-    int newest = -1, oldest = -1;
+    int waitStatus, status = 0;
+    process *running;
 
-    while (1)
+    while ((running = firstWithStatus(*process_list, jobId, RUNNING)))
     {
-        char buffer[PATH_MAX], input[INPUT_MAX] ;
-        char *history_line;
-        getcwd(buffer, PATH_MAX);
-        printf("~%s$ ", buffer);
-        fgets(input, 2048, stdin);
-
-        if (strcmp(input, "quit\n") == 0)
-        {
-            freeProcessList(&processList);
-            freeHistory(history);
-            break;
-        }
-        if (strcmp(input, "\n") == 0)
+        pid_t pid = waitpid(running->pid, &waitStatus, WUNTRACED);
+        if (pid == -1)
+        {/*Reaped elsewhere already*/
+            updateProcessStatus(process_list, running->pid, TERMINATED, running->exitCode, board);
             continue;
-
-        int isExcl = isExclamation(input);
-        if (isExcl == 0)
+        }
+        if (WIFSTOPPED(waitStatus))
         {
-            insertLastCmd(input, history[newest]);
-            printf("%s", input);
+            updateProcessStatus(process_list, pid, SUSPENDED, 0, board);
+            if (pid == lastPid)
+            {
+                status = 128 + WSTOPSIG(waitStatus);
+            }
         }
-        else if (isExcl >= 1)
+        else
         {
-            if (!insertNumCmd(input, history, oldest, isExcl))
+            running->termSignal = WIFSIGNALED(waitStatus) ? WTERMSIG(waitStatus) : 0;
+            updateProcessStatus(process_list, pid, TERMINATED, exitCodeOf(waitStatus), board);
+            if (pid == lastPid)
             {
-                continue;
+                status = exitCodeOf(waitStatus);
             }
-            printf("%s", input);
         }
+    }
 
-        cmdLine *cmd = parseCmdLines(input);
+    if (term->interactive)
+    {
+        tcsetpgrp(STDIN_FILENO, term->shellPgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &term->modes);
+    }
+    if (jobHasStatus(*process_list, jobId, SUSPENDED))
+    {
+        printf("\n");
+        printJob(*process_list, firstOfJob(*process_list, jobId));
+    }
+    return status;
+}
 
-        if (debug == 1)
-            printf("Executing: %s", input);
+void initPlacement(placement *place)
+{
+    memset(place, 0, sizeof(placement));
+    place->policy = PLACE_NONE;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &place->allowed) == -1)
+    {
+        perror("sched_getaffinity failed");
+    }
+}
+
+void discoverNodes(placement *place)
+{
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *entry;
+    char path[PATH_MAX], list[CPULIST_MAX];
+    int node;
 
-        int isHistoryCommand = strcmp(cmd->arguments[0], "history") == 0;
-        if ((isExcl == -1))
+    while (dir && (entry = readdir(dir)) && place->nodeCount < MAX_NODES)
+    {
+        if (sscanf(entry->d_name, "node%d", &node) != 1)
         {
-            history_line = malloc(INPUT_MAX);
-            strcpy(history_line, input);
-            addHistoryLine(history, &newest, &oldest, history_line);
+            continue;
         }
-        
-        if (handleSpecialCommands(cmd, &processList))
+        snprintf(path, PATH_MAX, "/sys/devices/system/node/%s/cpulist", entry->d_name);
+        FILE *file = fopen(path, "r");
+        if (!file)
         {
-            freeCmdLines(cmd);
             continue;
         }
-
-        int fd[2];
-        int needToPipe = 0;
-        if (cmd->next != NULL)
-        { /*PIPELINE!*/
-            needToPipe = 1;
-            if (pipe(fd) == -1)
+        if (fgets(list, CPULIST_MAX, file))
+        {
+            list[strcspn(list, "\n")] = '\0';
+            if (parseCpuList(list, &place->nodes[place->nodeCount]))
             {
-                freeCmdLines(cmd);
-                perror("Piping unsuccessful");
-                break;
+                place->nodeCount++;
             }
         }
+        fclose(file);
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+    if (place->nodeCount == 0)
+    {/*No NUMA information: treat the whole machine as a single node*/
+        CPU_ZERO(&place->nodes[0]);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET(cpu, &place->nodes[0]);
+        }
+        place->nodeCount = 1;
+    }
+}
 
-        /*Create child*/
-        pid_t pid1 = fork();
+int cpuSetToArray(cpu_set_t *cpus, int *array)
+{
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, cpus))
+        {
+            array[count++] = cpu;
+        }
+    }
+    return count;
+}
 
-        if (pid1 == 0)
-        { /*Child 1 process*/
-            if (needToPipe)
-            {
-                dup2(fd[1], STDOUT_FILENO);
-                close(fd[0]);
-                close(fd[1]);
-            }
-            if (cmd->inputRedirect)
-            {
-                freopen(cmd->inputRedirect, "r", stdin);
-            }
-            if (cmd->outputRedirect)
-            {
-                freopen(cmd->outputRedirect, "w", stdout);
-            }
-            if (isHistoryCommand)
-            {
-                printHistory(history, &newest, &oldest);
-                exit(0);
-            }
-            else
-            {
-                execute(cmd);
-            }
+/*Van der Corput sequence: 0, 1/2, 1/4, 3/4, ... keeps successive jobs far apart*/
+int spreadOffset(int index, int count)
+{
+    double offset = 0, bit = 0.5;
+    for (; index; index >>= 1, bit /= 2)
+    {
+        if (index & 1)
+        {
+            offset += bit;
         }
-        else
-        { /*Main process*/
-            addProcess(&processList, cmd, pid1);
+    }
+    return (int)(offset * count);
+}
 
-            if (cmd->blocking)
-            {
-                waitpid(pid1, NULL, 0);
-            }
-            else
-            {
-                usleep(10000);
-            }
+int countStages(cmdLine *cmd)
+{
+    int stages = 0;
+    for (; cmd; cmd = cmd->next)
+    {
+        stages++;
+    }
+    return stages;
+}
 
-            if (debug == 1)
-            {
-                printf("Child PID1: %d\n", pid1);
+/*CPUs held by live processes pinned to a single one, by a placement policy or an affinity prefix*/
+void heldCpus(process *process_list, cpu_set_t *held)
+{
+    CPU_ZERO(held);
+    for (; process_list; process_list = process_list->next)
+    {
+        if (process_list->status != TERMINATED && CPU_COUNT(&process_list->cpus) == 1)
+        {
+            CPU_OR(held, held, &process_list->cpus);
+        }
+    }
+}
+
+/*Index (in cpus) of the lowest block of stages neighbouring CPUs that are all free, or else of the lowest free CPU.
+  Returns -1 when every CPU is held*/
+int lowestFreeBlock(int *cpus, int count, int stages, cpu_set_t *held)
+{
+    int firstFree = -1, run = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (CPU_ISSET(cpus[i], held))
+        {
+            run = 0;
+            continue;
+        }
+        if (firstFree == -1)
+        {
+            firstFree = i;
+        }
+        if (++run >= stages)
+        {
+            return i - stages + 1;
+        }
+    }
+    return firstFree;
+}
+
+/*Picks the CPUs for every stage of a job. Stages of one pipeline land on neighbouring CPUs*/
+void placeJob(placement *place, process *process_list, cpu_set_t *jobCpus, int stages, cpu_set_t *stageCpus)
+{
+    int cpus[CPU_SETSIZE], count, base = 0;
+    cpu_set_t candidates;
+
+    CPU_AND(&candidates, jobCpus, &place->allowed);
+    if (CPU_COUNT(&candidates) == 0)
+    {
+        candidates = *jobCpus;
+    }
+
+    if (place->policy == PLACE_NONE)
+    {
+        for (int i = 0; i < stages; i++)
+        {
+            stageCpus[i] = candidates;
+        }
+        return;
+    }
+
+    if (place->policy == PLACE_SPREAD)
+    {/*Successive jobs go to successive NUMA nodes, then far apart inside the node*/
+        if (place->nodeCount == 0)
+        {
+            discoverNodes(place);
+        }
+        cpu_set_t onNode;
+        CPU_AND(&onNode, &candidates, &place->nodes[place->jobCount % place->nodeCount]);
+        if (CPU_COUNT(&onNode) > 0)
+        {
+            candidates = onNode;
+        }
+    }
+
+    count = cpuSetToArray(&candidates, cpus);
+    if (count == 0)
+    {/*Nothing to pin to: leave the job on whatever it was given*/
+        for (int i = 0; i < stages; i++)
+        {
+            stageCpus[i] = *jobCpus;
+        }
+        return;
+    }
+    if (place->policy == PLACE_ROUNDROBIN)
+    {
+        base = place->cursor % count;
+        place->cursor = (base + stages) % count;
+    }
+    else if (place->policy == PLACE_SPREAD)
+    {
+        base = spreadOffset(place->jobCount / place->nodeCount, count);
+    }
+    else if (place->policy == PLACE_COMPACT)
+    {/*Pack next to the jobs still running, wrapping around only once every CPU is held*/
+        cpu_set_t held;
+        heldCpus(process_list, &held);
+        if ((base = lowestFreeBlock(cpus, count, stages, &held)) == -1)
+        {
+            base = place->cursor % count;
+            place->cursor = (base + stages) % count;
+        }
+    }
+    place->jobCount++;
+
+    for (int i = 0; i < stages; i++)
+    {
+        CPU_ZERO(&stageCpus[i]);
+        CPU_SET(cpus[(base + i) % count], &stageCpus[i]);
+    }
+}
+
+/*Handles the "affinity <cpulist> command..." prefix. Returns the number of prefix arguments, or -1 on error*/
+int parseAffinityPrefix(cmdLine *cmd, placement *place, cpu_set_t *jobCpus)
+{
+    *jobCpus = place->allowed;
+    if (strcmp(cmd->arguments[0], "affinity") != 0)
+    {
+        return 0;
+    }
+    if (cmd->argCount < 3 || !parseCpuList(cmd->arguments[1], jobCpus))
+    {
+        fprintf(stderr, "usage: affinity <cpulist> command [args...]\n");
+        return -1;
+    }
+    return 2;
+}
+
+void shiftArguments(cmdLine *pCmdLine, int count)
+{
+    for (int i = 0; i + count <= pCmdLine->argCount; i++)
+    {
+        ((char **)pCmdLine->arguments)[i] = pCmdLine->arguments[i + count];
+    }
+    pCmdLine->argCount -= count;
+}
+
+void applyAffinity(cpu_set_t *cpus)
+{
+    if (sched_setaffinity(0, sizeof(cpu_set_t), cpus) == -1)
+    {
+        perror("sched_setaffinity failed");
+    }
+}
+
+void onPlacement(cmdLine *cmd, placement *place)
+{
+    const char *names[] = {"none", "compact", "spread", "roundrobin"};
+    char cpus[CPULIST_MAX];
+
+    if (cmd->argCount > 1)
+    {
+        int policy;
+        for (policy = PLACE_NONE; policy <= PLACE_ROUNDROBIN; policy++)
+        {
+            if (strcmp(cmd->arguments[1], names[policy]) == 0)
+            {
+                break;
+            }
+        }
+        if (policy > PLACE_ROUNDROBIN)
+        {
+            fprintf(stderr, "usage: placement [none|compact|spread|roundrobin] [cpulist]\n");
+            return;
+        }
+        if (cmd->argCount > 2)
+        {/*Parsed aside, so a rejected list leaves the current one in place*/
+            cpu_set_t requested, available;
+            if (!parseCpuList(cmd->arguments[2], &requested))
+            {
+                fprintf(stderr, "placement: bad cpu list: %s\n", cmd->arguments[2]);
+                return;
+            }
+            if (sched_getaffinity(0, sizeof(cpu_set_t), &available) == 0)
+            {
+                CPU_AND(&requested, &requested, &available);
+            }
+            if (CPU_COUNT(&requested) == 0)
+            {
+                fprintf(stderr, "placement: none of %s is available\n", cmd->arguments[2]);
+                return;
+            }
+            place->allowed = requested;
+        }
+        place->policy = policy;
+        place->cursor = 0;
+        place->jobCount = 0;
+    }
+
+    formatCpuList(&place->allowed, cpus, CPULIST_MAX);
+    printf("placement: %s on %s\n", names[place->policy], cpus);
+}
+
+char containsDebugFlag(int argc, char const *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*The path given with "-j <path>" to publish the job board at, or NULL*/
+const char *jobBoardPath(int argc, char const *argv[])
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+int isExclamation(char *input)
+{
+    if (strlen(input) < 3 || input[0] != '!') {
+        return -1;
+    }
+    if (input[1] == '!' && (input[2] == ' ' || input[2] == '\n'))
+    {
+        return 0;
+    }
+    int i;
+    for (i = 1; i < strlen(input); i++) 
+    {
+        if (!isdigit(input[i])) 
+        {
+            if (input[i] == ' ' || input[i] == '\n')
+            {
+                break;
+            }
+            return -1;
+        }
+    }
+    return atoi(input + 1);
+}
+
+
+/*suspend, wake and kill take "%n" or a pid, and reach every process of its job with one killpg.
+  A pid the shell didn't start is signalled alone*/
+void signalJob(process **process_list, cmdLine *cmd, int sig)
+{
+    if (cmd->argCount < 2)
+    {
+        return;
+    }
+    process *job = findJob(*process_list, cmd->arguments[1]);
+    if (!job && cmd->arguments[1][0] == '%')
+    {
+        fprintf(stderr, "%s: no such job\n", cmd->arguments[1]);
+        return;
+    }
+    if (!job)
+    {
+        if (kill(atoi(cmd->arguments[1]), sig) == -1)
+            perror("kill failed");
+        return;
+    }
+    if (signalJobProcesses(*process_list, job, sig) == -1)
+    {
+        perror("kill failed");
+    }
+    else if (sig == SIGINT && jobHasStatus(*process_list, job->jobId, SUSPENDED))
+    {/*A stopped job only acts on the signal once it runs again*/
+        signalJobProcesses(*process_list, job, SIGCONT);
+    }
+}
+
+void onJobs(process **process_list, jobBoard *board)
+{
+    updateProcessList(process_list, board);
+    for (process *current = *process_list; current; current = current->next)
+    {
+        if (firstOfJob(*process_list, current->jobId) == current)
+        {
+            printJob(*process_list, current);
+        }
+    }
+    /*Like procs, report finished jobs once*/
+    for (process *current = *process_list; current; )
+    {
+        if (!jobHasStatus(*process_list, current->jobId, RUNNING) && !jobHasStatus(*process_list, current->jobId, SUSPENDED))
+        {
+            current = removeProcess(process_list, current, board);
+        }
+        else
+        {
+            current = current->next;
+        }
+    }
+}
+
+/*fg and bg [%n|pid]: continue the job (the most recent one by default), fg also hands it the terminal and waits for it*/
+void continueJob(cmdLine *cmd, process **process_list, terminal *term, jobBoard *board)
+{
+    int foreground = strcmp(cmd->arguments[0], "fg") == 0;
+    updateProcessList(process_list, board);
+    process *job = findJob(*process_list, cmd->argCount > 1 ? cmd->arguments[1] : NULL);
+    if (!job || (!jobHasStatus(*process_list, job->jobId, RUNNING) && !jobHasStatus(*process_list, job->jobId, SUSPENDED)))
+    {
+        fprintf(stderr, "%s: no such job\n", cmd->argCount > 1 ? cmd->arguments[1] : "current");
+        return;
+    }
+
+    pid_t lastPid = job->pid;
+    for (process *current = job; current; current = current->next)
+    {
+        if (current->jobId == job->jobId)
+        {
+            lastPid = current->pid;
+        }
+    }
+
+    if (foreground && job->pgid)
+    {
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    if (signalJobProcesses(*process_list, job, SIGCONT) == -1)
+    {
+        perror("kill failed");
+    }
+    setJobStatus(process_list, job->jobId, RUNNING, board);
+    printJob(*process_list, job);
+    if (foreground)
+    {
+        waitForJob(process_list, job->jobId, lastPid, term, board);
+    }
+}
+
+int runSpecialCommand(cmdLine *cmd, process **process_list, placement *place, terminal *term, jobBoard *board)
+{
+    if (strcmp(cmd->arguments[0], "cd") == 0)
+    {
+        if (chdir(cmd->arguments[1]) == -1)
+            perror("cd failed");
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "suspend") == 0)
+    {
+        signalJob(process_list, cmd, SIGTSTP);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "wake") == 0)
+    {
+        signalJob(process_list, cmd, SIGCONT);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "kill") == 0)
+    {
+        signalJob(process_list, cmd, SIGINT);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "jobs") == 0)
+    {
+        onJobs(process_list, board);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "fg") == 0 || strcmp(cmd->arguments[0], "bg") == 0)
+    {
+        continueJob(cmd, process_list, term, board);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "placement") == 0)
+    {
+        onPlacement(cmd, place);
+        return 1;
+    }
+    if (strcmp(cmd->arguments[0], "procs") == 0)
+    {
+        onProcs(process_list, board);
+        return 1;
+    }
+
+    return 0;
+}
+
+cmdLine *expandInShell(cmdLine *cmd);
+
+int handleSpecialCommands(cmdLine *cmd, process **process_list, placement *place, terminal *term, jobBoard *board)
+{
+    static const char *specialCommands[] = {"cd", "suspend", "wake", "kill", "jobs", "fg", "bg", "placement", "procs"};
+
+    for (int i = 0; i < sizeof(specialCommands) / sizeof(specialCommands[0]); i++)
+    {
+        if (strcmp(cmd->arguments[0], specialCommands[i]) == 0)
+        {
+            cmdLine *expanded = expandInShell(cmd);
+            if (expanded)
+            {
+                runSpecialCommand(expanded, process_list, place, term, board);
             }
+            if (expanded != cmd)
+            {
+                freeCmdLines(expanded);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void freeHistory(historyEntry *history) {
+    for (int i = 0; i < HISTLEN; i++) {
+        free(history[i].line);
+        freeCmdLines(history[i].cmd);
+    }
+}
+
+/*Looks arguments[0] up in PATH once, so replays can execv it directly*/
+char *resolveExecPath(const char *name)
+{
+    char *path = getenv("PATH"), candidate[PATH_MAX];
+    if (!path || strchr(name, '/') || strstr(name, "$("))
+    {
+        return NULL;
+    }
+
+    while (*path)
+    {
+        int len = strcspn(path, ":");
+        if (path[0] == '/' && snprintf(candidate, PATH_MAX, "%.*s/%s", len, path, name) < PATH_MAX &&
+            access(candidate, X_OK) == 0)
+        {
+            return strdup(candidate);
+        }
+        path += len;
+        if (*path == ':')
+        {
+            path++;
+        }
+    }
+    return NULL;
+}
+
+void resolveExecPaths(cmdLine *cmd)
+{
+    for (; cmd; cmd = cmd->next)
+    {
+        cmd->execPath = resolveExecPath(commandName(cmd));
+    }
+}
+
+void addHistoryEntry(historyEntry *history, int *newest, int *oldest, char *line, cmdLine *cmd)
+{
+    if (*newest < 0 && *oldest < 0)
+    {/*History is empty*/
+        *newest = 0, *oldest = 0;
+    }
+    else
+    {
+        *newest = (*newest + 1) % HISTLEN;
+        if (*newest == *oldest) 
+        {
+            free(history[*oldest].line);
+            freeCmdLines(history[*oldest].cmd);
+            *oldest = (*oldest + 1) % HISTLEN;
+        }
+    }
+    history[*newest].line = line;
+    history[*newest].cmd = cmd;
+}
+
+int historyLength(int newest, int oldest)
+{
+    if (newest < 0)
+    {
+        return 0;
+    }
+    return (newest - oldest + HISTLEN) % HISTLEN + 1;
+}
+
+void printHistory(historyEntry *history, int *newest, int *oldest)
+{
+    for (int i = 0; i < historyLength(*newest, *oldest); i++) {
+        printf("%d. %s", i + 1, history[(*oldest + i) % HISTLEN].line);
+    }
+}
+
+/*Finds the entry replayed by "!!" (index 0) or "!n", or NULL if there is none*/
+historyEntry *findHistoryEntry(historyEntry *history, int newest, int oldest, int index)
+{
+    int length = historyLength(newest, oldest);
+    if (index == 0 && length > 0)
+    {
+        return &history[newest];
+    }
+    if (index < 1 || index > length)
+    {
+        printf("History is too short\n");
+        return NULL;
+    }
+    return &history[(oldest + index - 1) % HISTLEN];
+}
+
+/*The text typed after "!!" or "!n", which extends the replayed command*/
+char *replaySuffix(char *input, int index)
+{
+    char *suffix = input + 1;
+    if (index == 0)
+    {
+        return input + 2;
+    }
+    while (isdigit(*suffix))
+    {
+        suffix++;
+    }
+    return suffix;
+}
+
+int isBlank(const char *str)
+{
+    while (*str)
+    {
+        if (!isspace((unsigned char)*str++))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int isProcSubstitution(const char *arg)
+{
+    if ((arg[0] != '<' && arg[0] != '>') || arg[1] != '(')
+    {
+        return 0;
+    }
+    const char *end = findSubstitutionEnd(arg + 1);
+    return *end && end[1] == '\0';
+}
+
+/*Substituted redirections are bound by bindProcSubstitutions instead*/
+void redirectStreams(cmdLine *pCmdLine)
+{
+    if (pCmdLine->inputRedirect && !isProcSubstitution(pCmdLine->inputRedirect))
+    {
+        freopen(pCmdLine->inputRedirect, "r", stdin);
+    }
+    if (pCmdLine->outputRedirect && !isProcSubstitution(pCmdLine->outputRedirect))
+    {
+        freopen(pCmdLine->outputRedirect, "w", stdout);
+    }
+}
+
+void execute(cmdLine *pCmdLine);
+int runCmdChain(cmdLine *cmd);
+
+/*The text at slot of stage: an argument index, or SUBST_INPUT/SUBST_OUTPUT for its redirections*/
+const char *substitutionSlot(cmdLine *stage, int slot)
+{
+    if (slot == SUBST_INPUT)
+    {
+        return stage->inputRedirect;
+    }
+    if (slot == SUBST_OUTPUT)
+    {
+        return stage->outputRedirect;
+    }
+    return slot > 0 ? stage->arguments[slot] : NULL;
+}
+
+/*Reports a chain with more <(...) and >(...) than startProcSubstitutions can start, so it isn't launched with some left as text*/
+int tooManyProcSubstitutions(cmdLine *cmd)
+{
+    int count = 0;
+    for (cmdLine *stage = cmd; stage; stage = stage->next)
+    {
+        for (int i = SUBST_OUTPUT; i < stage->argCount; i++)
+        {
+            const char *arg = substitutionSlot(stage, i);
+            count += arg && isProcSubstitution(arg);
+        }
+    }
+    if (count > MAX_SUBSTITUTIONS)
+    {
+        fprintf(stderr, "%s: too many process substitutions (at most %d)\n", cmd->arguments[0], MAX_SUBSTITUTIONS);
+        return 1;
+    }
+    return 0;
+}
+
+/*Starts every <(...) and >(...) of the chain concurrently, before the commands themselves are forked.
+  When job is given they join its process group and are tracked in process_list along with the rest of the job*/
+int startProcSubstitutions(cmdLine *cmd, procSubstitution *substs, process **process_list, cpu_set_t *cpus,
+                           jobLaunch *job, jobBoard *board)
+{
+    int count = 0, fd[2];
+
+    for (cmdLine *stage = cmd; stage; stage = stage->next)
+    {
+        for (int i = SUBST_OUTPUT; i < stage->argCount && count < MAX_SUBSTITUTIONS; i++)
+        {
+            const char *arg = substitutionSlot(stage, i);
+            if (!arg || !isProcSubstitution(arg))
+            {
+                continue;
+            }
+            char *text = strndup(arg + 2, strlen(arg) - 3);
+            cmdLine *inner = parseCmdLines(text);
+            free(text);
+            if (!inner || pipe(fd) == -1)
+            {
+                freeCmdLines(inner);
+                continue;
+            }
+
+            int reading = arg[0] == '<';
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                if (job)
+                {
+                    enterJob(job);
+                }
+                dup2(reading ? fd[1] : fd[0], reading ? STDOUT_FILENO : STDIN_FILENO);
+                close(fd[0]);
+                close(fd[1]);
+                for (int j = 0; j < count; j++)
+                {
+                    close(substs[j].fd);
+                }
+                _exit(runCmdChain(inner));
+            }
+
+            close(reading ? fd[1] : fd[0]);
+            substs[count].idx = stage->idx;
+            substs[count].arg = i;
+            substs[count].fd = reading ? fd[0] : fd[1];
+            substs[count].pid = pid;
+            count++;
+            if (job)
+            {
+                joinJob(job, pid);
+                addProcess(process_list, inner, pid, cpus, job->id, job->pgid);
+                launchJob(board, pid, commandName(inner));
+            }
+            freeCmdLines(inner);
+        }
+    }
+    return count;
+}
+
+/*Runs in the command's child: keeps its own pipe ends and passes them as /dev/fd paths, or as the stream they redirect*/
+void bindProcSubstitutions(cmdLine *pCmdLine, procSubstitution *substs, int count)
+{
+    char path[32];
+    for (int i = 0; i < count; i++)
+    {
+        if (substs[i].idx != pCmdLine->idx)
+        {
+            close(substs[i].fd);
+            continue;
+        }
+        if (substs[i].arg < 0)
+        {
+            dup2(substs[i].fd, substs[i].arg == SUBST_INPUT ? STDIN_FILENO : STDOUT_FILENO);
+            close(substs[i].fd);
+            continue;
+        }
+        snprintf(path, sizeof(path), "/dev/fd/%d", substs[i].fd);
+        ((char **)pCmdLine->arguments)[substs[i].arg] = strdup(path);
+    }
+}
+
+void closeProcSubstitutions(procSubstitution *substs, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        close(substs[i].fd);
+    }
+}
+
+int runCmdChain(cmdLine *cmd)
+{
+    int fd[2], inFd = -1, status = 0, childStatus;
+    pid_t pid, lastPid = -1;
+    procSubstitution substs[MAX_SUBSTITUTIONS];
+    /*A subshell waits for its own children, the shell's handler would only write to its pipe*/
+    signal(SIGCHLD, SIG_DFL);
+    if (tooManyProcSubstitutions(cmd))
+    {
+        return 1;
+    }
+    int substCount = startProcSubstitutions(cmd, substs, NULL, NULL, NULL, NULL);
+
+    for (cmdLine *stage = cmd; stage; stage = stage->next)
+    {
+        if (stage->next && pipe(fd) == -1)
+        {
+            perror("Piping unsuccessful");
+            return 1;
+        }
+
+        pid = fork();
+        if (pid == 0)
+        {
+            if (inFd != -1)
+            {
+                dup2(inFd, STDIN_FILENO);
+                close(inFd);
+            }
+            if (stage->next)
+            {
+                dup2(fd[1], STDOUT_FILENO);
+                close(fd[0]);
+                close(fd[1]);
+            }
+            redirectStreams(stage);
+            bindProcSubstitutions(stage, substs, substCount);
+            execute(stage);
+        }
+
+        if (inFd != -1)
+        {
+            close(inFd);
+        }
+        if (stage->next)
+        {
+            close(fd[1]);
+            inFd = fd[0];
+        }
+        lastPid = pid;
+    }
+    closeProcSubstitutions(substs, substCount);
+
+    while ((pid = wait(&childStatus)) > 0)
+    {
+        if (pid == lastPid)
+        {
+            status = WIFEXITED(childStatus) ? WEXITSTATUS(childStatus) : 1;
+        }
+    }
+    return status;
+}
+
+void reserveCapture(captureBuffer *buf, size_t extra)
+{
+    if (buf->len + extra + 1 <= buf->cap)
+    {
+        return;
+    }
+    /*Grow geometrically so capturing n bytes costs O(n) copying overall*/
+    while (buf->len + extra + 1 > buf->cap)
+    {
+        buf->cap = buf->cap ? buf->cap * 2 : CAPTURE_CHUNK;
+    }
+    buf->data = realloc(buf->data, buf->cap);
+}
+
+void appendCapture(captureBuffer *buf, const char *bytes, size_t n)
+{
+    reserveCapture(buf, n);
+    memcpy(buf->data + buf->len, bytes, n);
+    buf->len += n;
+    buf->data[buf->len] = '\0';
+}
+
+int captureOutput(int fd, captureBuffer *buf)
+{
+    while (1)
+    {
+        /*Read straight into the spare capacity, no intermediate buffer*/
+        reserveCapture(buf, CAPTURE_CHUNK / 2);
+        ssize_t n = read(fd, buf->data + buf->len, buf->cap - buf->len - 1);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            buf->data[buf->len] = '\0';
+            return (int)n;
+        }
+        buf->len += n;
+    }
+}
+
+int runSubstitution(const char *text, captureBuffer *out)
+{
+    int fd[2], status;
+    if (pipe(fd) == -1)
+    {
+        perror("Piping unsuccessful");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        cmdLine *inner = parseCmdLines(text);
+        _exit(inner ? runCmdChain(inner) : 0);
+    }
+
+    close(fd[1]);
+    if (captureOutput(fd[0], out) == -1)
+    {
+        perror("Failed reading command substitution");
+    }
+    close(fd[0]);
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+/*Captures the output of the $(...) starting at open, and returns a pointer past its ')'*/
+const char *substitute(const char *open, captureBuffer *out)
+{
+    const char *end = findSubstitutionEnd(open + 1);
+    char *text = strndup(open + 2, end - open - 2);
+    runSubstitution(text, out);
+    free(text);
+    while (out->len > 0 && out->data[out->len - 1] == '\n')
+    {
+        out->data[--out->len] = '\0';
+    }
+    return *end ? end + 1 : end;
+}
+
+void pushPointer(char ***array, int *count, int *cap, char *value)
+{
+    if (*count + 1 >= *cap)
+    {
+        *cap = *cap ? *cap * 2 : MAX_ARGUMENTS;
+        *array = realloc(*array, *cap * sizeof(char *));
+    }
+    (*array)[(*count)++] = value;
+    (*array)[*count] = NULL;
+}
+
+void freeExpansion(expansion *args)
+{
+    for (int i = 0; i < args->blockCount; i++)
+    {
+        free(args->blocks[i]);
+    }
+    free(args->blocks);
+    free(args->argv);
+}
+
+/*Builds the argument vector with every $(...) replaced by its output.
+  It grows as needed, since a substitution may produce any number of fields*/
+void expandCmdSubstitutions(cmdLine *pCmdLine, expansion *args)
+{
+    for (int i = 0; i < pCmdLine->argCount; i++)
+    {
+        char *arg = pCmdLine->arguments[i];
+        char *open = strstr(arg, "$(");
+        if (!open)
+        {
+            pushPointer(&args->argv, &args->argc, &args->argCap, arg);
+            continue;
+        }
 
-            if (needToPipe)
+        captureBuffer buf = {NULL, 0, 0};
+        const char *end = findSubstitutionEnd(arg + 1);
+        if (open == arg && *end && end[1] == '\0')
+        {/*The whole word is a substitution: split the capture into fields in place*/
+            substitute(arg, &buf);
+            if (!buf.data)
             {
-                pid_t pid2 = fork();
-                if (pid2 != 0)
-                { /*Main process*/
-                    if (debug == 1)
-                    {
-                        printf("Child PID2: %d\n", pid2);
-                    }
-                    addProcess(&processList, cmd->next, pid2);
-                    close(fd[1]);
-                    close(fd[0]);
-                    if (cmd->next->blocking)
-                    {
-                        waitpid(pid2, NULL, 0);
-                    }
+                continue;
+            }
+            pushPointer(&args->blocks, &args->blockCount, &args->blockCap, buf.data);
+            char *field = buf.data;
+            while (1)
+            {
+                while (*field && isspace((unsigned char)*field))
+                {
+                    *field++ = '\0';
+                }
+                if (!*field)
+                {
+                    break;
                 }
-                else
-                { /*Child 2 process*/
-                    dup2(fd[0], STDIN_FILENO);
-                    close(fd[1]);
-                    close(fd[0]);
-                    if (cmd->next->inputRedirect)
-                    {
-                        freopen(cmd->next->inputRedirect, "r", stdin);
-                    }
-                    if (cmd->next->outputRedirect)
-                    {
-                        freopen(cmd->next->outputRedirect, "w", stdout);
-                    }
-                    execute(cmd->next);
+                pushPointer(&args->argv, &args->argc, &args->argCap, field);
+                while (*field && !isspace((unsigned char)*field))
+                {
+                    field++;
+                }
+            }
+            continue;
+        }
+
+        /*Substitutions inside a word expand to a single argument*/
+        captureBuffer word = {NULL, 0, 0};
+        const char *rest = arg;
+        while ((open = strstr(rest, "$(")))
+        {
+            appendCapture(&word, rest, open - rest);
+            buf.len = 0;
+            rest = substitute(open, &buf);
+            appendCapture(&word, buf.data, buf.len);
+        }
+        appendCapture(&word, rest, strlen(rest));
+        free(buf.data);
+        pushPointer(&args->blocks, &args->blockCount, &args->blockCap, word.data);
+        pushPointer(&args->argv, &args->argc, &args->argCap, word.data);
+    }
+}
+
+/*Builtins run in the shell itself, so their $(...) are expanded here, on a copy of the cached chain.
+  Returns cmd itself when there is nothing to expand, or NULL if the result doesn't fit a cmdLine*/
+cmdLine *expandInShell(cmdLine *cmd)
+{
+    int found = 0;
+    for (int i = 0; i < cmd->argCount; i++)
+    {
+        found |= strstr(cmd->arguments[i], "$(") != NULL;
+    }
+    if (!found)
+    {
+        return cmd;
+    }
+
+    expansion args = {NULL, 0, 0, NULL, 0, 0};
+    expandCmdSubstitutions(cmd, &args);
+    if (args.argc > MAX_ARGUMENTS - 1)
+    {
+        fprintf(stderr, "%s: too many arguments after substitution (at most %d)\n", cmd->arguments[0], MAX_ARGUMENTS - 1);
+        freeExpansion(&args);
+        return NULL;
+    }
+
+    cmdLine *copy = cloneCmdLines(cmd);
+    for (int i = 0; i < copy->argCount; i++)
+    {
+        free((char *)copy->arguments[i]);
+    }
+    for (int i = 0; i < args.argc; i++)
+    {
+        ((char **)copy->arguments)[i] = strdup(args.argv[i]);
+    }
+    ((char **)copy->arguments)[args.argc] = NULL;
+    copy->argCount = args.argc;
+    freeExpansion(&args);
+    return copy;
+}
+
+/*Runs in the child, which execs right away, so the expanded arguments are never freed*/
+void execute(cmdLine *pCmdLine)
+{
+    expansion args = {NULL, 0, 0, NULL, 0, 0};
+    expandCmdSubstitutions(pCmdLine, &args);
+    if (args.argc == 0)
+    {
+        exit(0);
+    }
+    if (pCmdLine->execPath)
+    {/*Resolved when the line entered history; falls back to a PATH search if it went stale*/
+        execv(pCmdLine->execPath, args.argv);
+    }
+    if (execvp(args.argv[0], args.argv) == -1)
+    {
+        perror("Failed command execution");
+        exit(1);
+    }
+}
+
+
+/*Forks every command of the chain, connected by pipes.
+  Returns the exit code of the last command once the chain finished, or 0 for a non-blocking chain*/
+int executeCmdLines(cmdLine *cmd, process **process_list, placement *place, terminal *term, jobBoard *board,
+                    historyEntry *history, int *newest, int *oldest, char debug)
+{
+    int stages = countStages(cmd), forked = 0, fd[2], inFd = -1;
+    cpu_set_t jobCpus, stageCpus[stages];
+    pid_t pids[stages];
+    cmdLine *last = cmd;
+
+    int prefixArgs = parseAffinityPrefix(cmd, place, &jobCpus);
+    if (prefixArgs == -1 || tooManyProcSubstitutions(cmd))
+    {
+        return 1;
+    }
+    if (place->policy == PLACE_COMPACT)
+    {/*Compact packs around the CPUs live jobs hold, so their status must be current*/
+        updateProcessList(process_list, board);
+    }
+    placeJob(place, *process_list, &jobCpus, stages, stageCpus);
+    jobLaunch job = {nextJobId(*process_list), 0, lastCmdLine(cmd)->blocking, term};
+
+    /*Started before the pipeline's pipes exist, so they don't hold their ends open*/
+    procSubstitution substs[MAX_SUBSTITUTIONS];
+    int substCount = startProcSubstitutions(cmd, substs, process_list, &jobCpus, &job, board);
+
+    for (cmdLine *stage = cmd; stage; stage = stage->next)
+    {
+        if (stage->next && pipe(fd) == -1)
+        {
+            perror("Piping unsuccessful");
+            break;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        { /*Child process*/
+            enterJob(&job);
+            if (inFd != -1)
+            {
+                dup2(inFd, STDIN_FILENO);
+                close(inFd);
+            }
+            if (stage->next)
+            {
+                dup2(fd[1], STDOUT_FILENO);
+                close(fd[0]);
+                close(fd[1]);
+            }
+            redirectStreams(stage);
+            applyAffinity(&stageCpus[stage->idx]);
+            bindProcSubstitutions(stage, substs, substCount);
+            if (stage->idx == 0)
+            {
+                shiftArguments(stage, prefixArgs);
+            }
+            if (strcmp(stage->arguments[0], "history") == 0)
+            {
+                printHistory(history, newest, oldest);
+                exit(0);
+            }
+            execute(stage);
+        }
+
+        /*Main process*/
+        if (debug == 1)
+        {
+            printf("Child PID%d: %d\n", stage->idx + 1, pid);
+        }
+        joinJob(&job, pid);
+        addProcess(process_list, stage, pid, &stageCpus[stage->idx], job.id, job.pgid);
+        launchJob(board, pid, commandName(stage));
+        pids[forked++] = pid;
+        if (inFd != -1)
+        {
+            close(inFd);
+        }
+        if (stage->next)
+        {
+            close(fd[1]);
+            inFd = fd[0];
+        }
+        last = stage;
+    }
+    closeProcSubstitutions(substs, substCount);
+
+    if (!forked)
+    {
+        return 1;
+    }
+    if (!last->blocking)
+    {
+        printf("[%d] %d\n", job.id, firstOfJob(*process_list, job.id)->pid);
+        return 0;
+    }
+
+    return waitForJob(process_list, job.id, pids[forked - 1], term, board);
+}
+
+double elapsedMs(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+double timevalMs(struct timeval *tv)
+{
+    return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*Nearest-rank percentile of sorted samples*/
+double percentile(double *sorted, int count, int percent)
+{
+    int rank = (percent * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+process *lastProcess(process *process_list)
+{
+    while (process_list && process_list->next)
+    {
+        process_list = process_list->next;
+    }
+    return process_list;
+}
+
+/*Drops the terminated processes added after mark, so repeated runs don't pile up in procs.
+  Stopped ones stay, so the job can still be reached with fg*/
+void removeProcessesAfter(process **process_list, process *mark, jobBoard *board)
+{
+    process *current = mark ? mark->next : *process_list;
+    while (current)
+    {
+        if (current->status == TERMINATED)
+        {
+            current = removeProcess(process_list, current, board);
+        }
+        else
+        {
+            current = current->next;
+        }
+    }
+}
+
+/*A run stopped by Ctrl-Z or killed by a signal ends the benchmark. SIGPIPE doesn't count, it is how pipelines like yes | head end*/
+int runInterrupted(process *process_list, process *mark)
+{
+    for (process *current = mark ? mark->next : process_list; current; current = current->next)
+    {
+        if (current->status == SUSPENDED || (current->termSignal && current->termSignal != SIGPIPE))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void printJsonString(const char *str)
+{
+    putchar('"');
+    for (; *str; str++)
+    {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+        {
+            printf("\\%c", c);
+        }
+        else if (c == '\n')
+        {
+            printf("\\n");
+        }
+        else if (c == '\t')
+        {
+            printf("\\t");
+        }
+        else if (c < 0x20)
+        {/*JSON allows no raw control characters inside a string*/
+            printf("\\u%04x", c);
+        }
+        else
+        {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+void printCmdLines(cmdLine *cmd, int json)
+{
+    for (; cmd; cmd = cmd->next)
+    {
+        for (int i = 0; i < cmd->argCount; i++)
+        {
+            if (json)
+            {
+                printJsonString(cmd->arguments[i]);
+                printf("%s", i + 1 < cmd->argCount ? ", " : "");
+            }
+            else
+            {
+                printf("%s%s", cmd->arguments[i], i + 1 < cmd->argCount ? " " : "");
+            }
+        }
+        if (cmd->next)
+        {
+            printf(json ? ", \"|\", " : " | ");
+        }
+    }
+}
+
+/*bench [-n runs] [-w warmup] [-j] command line: runs it repeatedly through executeCmdLines*/
+void onBench(cmdLine *cmd, process **process_list, placement *place, terminal *term, jobBoard *board,
+             historyEntry *history, int *newest, int *oldest, char debug)
+{
+    int runs = BENCH_RUNS, warmup = BENCH_WARMUP, json = 0, first = 1;
+
+    for (; first < cmd->argCount && cmd->arguments[first][0] == '-'; first++)
+    {
+        if (strcmp(cmd->arguments[first], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if (strcmp(cmd->arguments[first], "-n") == 0 && first + 1 < cmd->argCount)
+        {
+            runs = atoi(cmd->arguments[++first]);
+        }
+        else if (strcmp(cmd->arguments[first], "-w") == 0 && first + 1 < cmd->argCount)
+        {
+            warmup = atoi(cmd->arguments[++first]);
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (first >= cmd->argCount || runs < 1 || runs > BENCH_MAX_RUNS || warmup < 0 || warmup > BENCH_MAX_RUNS)
+    {
+        fprintf(stderr, "usage: bench [-n runs] [-w warmup] [-j] command [args...] [| command ...]\n");
+        fprintf(stderr, "runs must be between 1 and %d\n", BENCH_MAX_RUNS);
+        return;
+    }
+
+    /*A copy without the bench arguments, always blocking so every run is timed to completion*/
+    cmdLine *job = cloneCmdLines(cmd);
+    for (int i = 0; i < first; i++)
+    {
+        free((char *)job->arguments[i]);
+    }
+    shiftArguments(job, first);
+    free((char *)job->execPath);
+    job->execPath = resolveExecPath(commandName(job));
+    cmdLine *last = lastCmdLine(job);
+    last->blocking = 1;
+
+    double *wall = malloc(runs * sizeof(double)), userMs = 0, sysMs = 0;
+    int failures = 0;
+    for (int i = 0; i < warmup + runs; i++)
+    {
+        struct timespec start, end;
+        struct rusage before, after;
+        process *mark = lastProcess(*process_list);
+
+        getrusage(RUSAGE_CHILDREN, &before);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int status = executeCmdLines(job, process_list, place, term, board, history, newest, oldest, debug);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        getrusage(RUSAGE_CHILDREN, &after);
+        int interrupted = runInterrupted(*process_list, mark);
+        removeProcessesAfter(process_list, mark, board);
+
+        if (interrupted)
+        {/*Report the runs that completed, a stopped job stays reachable with fg*/
+            runs = i > warmup ? i - warmup : 0;
+            fprintf(stderr, "bench: interrupted, %d runs completed\n", runs);
+            break;
+        }
+        if (i < warmup)
+        {
+            continue;
+        }
+        wall[i - warmup] = elapsedMs(&start, &end);
+        userMs += timevalMs(&after.ru_utime) - timevalMs(&before.ru_utime);
+        sysMs += timevalMs(&after.ru_stime) - timevalMs(&before.ru_stime);
+        failures += status != 0;
+    }
+    if (runs == 0)
+    {
+        free(wall);
+        freeCmdLines(job);
+        return;
+    }
+    qsort(wall, runs, sizeof(double), compareDoubles);
+
+    if (json)
+    {
+        printf("{\"command\": [");
+        printCmdLines(job, 1);
+        printf("], \"runs\": %d, \"warmup\": %d, \"failures\": %d, ", runs, warmup, failures);
+        printf("\"wall_ms\": {\"min\": %.3f, \"median\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}, ",
+               wall[0], percentile(wall, runs, 50), percentile(wall, runs, 95), percentile(wall, runs, 99), wall[runs - 1]);
+        printf("\"user_ms_mean\": %.3f, \"sys_ms_mean\": %.3f}\n", userMs / runs, sysMs / runs);
+    }
+    else
+    {
+        printf("bench: ");
+        printCmdLines(job, 0);
+        printf("\n%d runs (%d warmup), %d failed\n", runs, warmup, failures);
+        printf("wall ms: min %.3f  median %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+               wall[0], percentile(wall, runs, 50), percentile(wall, runs, 95), percentile(wall, runs, 99), wall[runs - 1]);
+        printf("cpu ms (mean): user %.3f  sys %.3f\n", userMs / runs, sysMs / runs);
+    }
+    free(wall);
+    freeCmdLines(job);
+}
+
+/*Copies the history lines, oldest first, for the line editor's Up/Down keys*/
+int historyLines(historyEntry *history, int newest, int oldest, char **lines)
+{
+    int length = historyLength(newest, oldest);
+    for (int i = 0; i < length; i++)
+    {
+        lines[i] = history[(oldest + i) % HISTLEN].line;
+    }
+    return length;
+}
+
+int main(int argc, char const *argv[])
+{
+    struct process *processList = NULL;
+    char debug = containsDebugFlag(argc, argv);
+    placement place;
+    initPlacement(&place);
+    historyEntry history[HISTLEN] = {{NULL, NULL}};
+    int newest = -1, oldest = -1;
+    const char *boardPath = jobBoardPath(argc, argv);
+    jobBoard *board = boardPath ? createJobBoard(boardPath) : NULL;
+    terminal term;
+    initTerminal(&term);
+    static const char *builtins[] = {"cd", "quit", "history", "procs", "jobs", "fg", "bg", "suspend", "wake", "kill",
+                                     "placement", "affinity", "bench"};
+    setBuiltinCommands(builtins, sizeof(builtins) / sizeof(builtins[0]));
+    childWatch watch;
+    watchChildren(&watch, &processList, board);
+
+    while (1)
+    {
+        char buffer[PATH_MAX], prompt[PATH_MAX + 4], input[INPUT_MAX] ;
+        char *lines[HISTLEN];
+        if (board)
+        {/*Keep the board fresh for background jobs that finished since the last command*/
+            updateProcessList(&processList, board);
+        }
+        getcwd(buffer, PATH_MAX);
+        snprintf(prompt, sizeof(prompt), "~%s$ ", buffer);
+        if (!readLine(prompt, input, INPUT_MAX, lines, historyLines(history, newest, oldest, lines)))
+        {/*End of input quits like "quit" does*/
+            strcpy(input, "quit\n");
+        }
+
+        if (strcmp(input, "quit\n") == 0)
+        {
+            freeProcessList(&processList);
+            freeHistory(history);
+            freeLineEditor();
+            destroyJobBoard(board, boardPath);
+            break;
+        }
+        if (strcmp(input, "\n") == 0)
+            continue;
+
+        int isExcl = isExclamation(input);
+        cmdLine *cmd, *ownedCmd = NULL;
+        if (isExcl >= 0)
+        {/*Replay the cached chain, only the appended text (if any) gets parsed*/
+            historyEntry *entry = findHistoryEntry(history, newest, oldest, isExcl);
+            if (!entry)
+            {
+                continue;
+            }
+            char *suffix = replaySuffix(input, isExcl);
+            if (isBlank(suffix))
+            {
+                cmd = entry->cmd;
+            }
+            else
+            {
+                cmd = ownedCmd = extendCmdLines(entry->cmd, suffix);
+                if (!cmd)
+                {
+                    continue;
                 }
             }
-            usleep(10000);
-            freeCmdLines(cmd);
+            printf("%.*s%s", (int)strlen(entry->line) - 1, entry->line, suffix);
+        }
+        else
+        {
+            cmd = parseCmdLines(input);
+            if (!cmd)
+            {
+                continue;
+            }
+            resolveExecPaths(cmd);
+            addHistoryEntry(history, &newest, &oldest, strdup(input), cmd);
+        }
+
+        if (debug == 1)
+            printf("Executing: %s", input);
+
+        if (handleSpecialCommands(cmd, &processList, &place, &term, board))
+        {
+            freeCmdLines(ownedCmd);
+            continue;
+        }
+
+        if (strcmp(cmd->arguments[0], "bench") == 0)
+        {
+            onBench(cmd, &processList, &place, &term, board, history, &newest, &oldest, debug);
+        }
+        else
+        {
+            executeCmdLines(cmd, &processList, &place, &term, board, history, &newest, &oldest, debug);
         }
+        freeCmdLines(ownedCmd);
     }
     return 0;
 }